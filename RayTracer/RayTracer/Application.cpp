@@ -1,14 +1,537 @@
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <thread>
 #include "Renderer.h"
 #include "CRTScene.h"
+#include "CRTSceneParser.h"
+#include "CRTBenchmark.h"
+#include "CRTCoordinator.h"
+#include "CRTRenderServer.h"
+#include "CRTTimeline.h"
 
-int main()
+// RayTracer.exe --bench [--scenes <dir>] [--scene <name filter>] [--warmup <n>] [--repeat <n>]
+//                       [--scale <resolution scale>] [--json <output file>]
+static int runBenchmark(int argc, char** argv)
 {
-	CRTScene scene("Scenes/scene4_Lec12.crtscene");
+	CRTBenchmarkSettings settings;
+
+	for (int i = 2; i + 1 < argc; i += 2)
+	{
+		const std::string option = argv[i];
+		const char* value = argv[i + 1];
+
+		if (option == "--scenes")
+			settings.scenesDirectory = value;
+		else if (option == "--scene")
+			settings.sceneFilter = value;
+		else if (option == "--warmup")
+			settings.warmup = std::stoi(value);
+		else if (option == "--repeat")
+			settings.repeat = std::stoi(value);
+		else if (option == "--scale")
+			settings.resolutionScale = std::stof(value);
+		else if (option == "--json")
+			settings.outputFile = value;
+		else
+		{
+			std::cout << "Unknown benchmark option " << option << std::endl;
+			return 1;
+		}
+	}
+
+	CRTBenchmark benchmark(settings);
+
+	return benchmark.run() ? 0 : 1;
+}
+
+// Renders the scene, then renders it again every time the scene file is saved.
+// Only what changed in the file is prepared again, see CRTScene::reload.
+static void watchScene(CRTScene& scene, const Renderer& renderer, const std::string& sceneFile,
+					   const std::string& outputFile, const std::function<void()>& applyOverrides)
+{
+	renderer.renderScene(outputFile);
+
+	std::error_code error;
+	auto lastWriteTime = std::filesystem::last_write_time(sceneFile, error);
+	std::cout << "Watching " << sceneFile << std::endl;
+
+	while (true)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		auto writeTime = std::filesystem::last_write_time(sceneFile, error);
+		if (error || writeTime == lastWriteTime)
+			continue;
+
+		lastWriteTime = writeTime;
+
+		auto reloadStart = std::chrono::steady_clock::now();
+		CRTSceneChanges changes = scene.reload(sceneFile);
+		applyOverrides();
+		auto reloadEnd = std::chrono::steady_clock::now();
+
+		std::cout << "Reloaded in " << std::chrono::duration<double, std::milli>(reloadEnd - reloadStart).count()
+				  << " ms: ";
+		changes.print(std::cout);
+		std::cout << std::endl;
+
+		if (changes.isEmpty())
+			continue;
+
+		renderer.renderScene(outputFile);
+		auto renderEnd = std::chrono::steady_clock::now();
+
+		std::cout << "Save to image in " << std::chrono::duration<double, std::milli>(renderEnd - reloadStart).count()
+				  << " ms" << std::endl;
+	}
+}
+
+// RayTracer.exe --send <port> <request>...
+// Sends one request to a render server, e.g. --send 7070 render out.ppm size 640 360 pan 10
+static int runClient(int argc, char** argv)
+{
+	if (argc < 4)
+	{
+		std::cout << "Usage: --send <port> <request>" << std::endl;
+		return 1;
+	}
+
+	std::string request = argv[3];
+	for (int i = 4; i < argc; i++)
+	{
+		request += std::string(" ") + argv[i];
+	}
+
+	std::string reply;
+	if (!CRTRenderServer::sendRequest(std::stoi(argv[2]), request, reply))
+	{
+		std::cout << "No reply from the server on port " << argv[2] << std::endl;
+		return 1;
+	}
+
+	std::cout << reply << std::endl;
+	return reply.compare(0, 2, "ok") == 0 ? 0 : 1;
+}
+
+// RayTracer.exe [<scene file> [<output file>]] [--stats] [--threads <n>] [--trace <trace file>]
+//               [--heatmap]
+//               [--progressive] [--samples <max samples>] [--budget <seconds>] [--snapshot <seconds>]
+//               [--aa] [--aa-strata <n>] [--aa-rounds <n>] [--aa-threshold <standard error>]
+//               [--sampler random|halton|sobol] [--max-depth <n>] [--roulette <depth>] [--single-branch]
+//               [--light-samples <n>] [--light-cull <threshold>] [--shadow-cache] [--shadow-batch]
+//               [--aperture <radius>] [--focus <distance>] [--shutter <fraction>]
+//               [--compact-meshes] [--quantize-positions] [--bvh float|compressed] [--bvh-cache <directory>]
+//               [--region <x0> <y0> <x1> <y1>] [--patch] [--animation] [--frames <first> <count>]
+//               [--coordinate <workers>] [--job-size <pixels>] [--frames-per-job <n>] [--attempts <n>]
+//               [--worker <executable>] [--serve <port>] [--watch]
+// --max-depth and --roulette override max_ray_depth and russian_roulette_depth of the scene settings
+// --aperture and --focus give the camera a thin lens, see CRTCamera::setLens. --shutter, only with
+// --animation, keeps the shutter open for that fraction of the time between frames, centred on the frame,
+// while the camera orbits. Depth of field shows with --progressive or --aa, motion blur with --aa; single
+// samples go through the lens centre at the frame's pose.
+// --compact-meshes stores the shading data of the meshes compressed, see CRTCompactMesh, and
+// --quantize-positions also quantizes their vertex positions, which the triangles are then intersected with
+// --bvh builds a BVH for every mesh large enough to profit from one, see CRTBVH. With --bvh-cache the
+// BVHs, float ones unless --bvh says otherwise, are mapped from the cache files in the directory,
+// and the missing ones are written there.
+// --region renders only the pixels [x0, x1) x [y0, y1) of a single frame and writes them as a cropped
+// image, or with --patch into the full-size image already in the output file
+// --coordinate renders the frame, or with --animation the animation, in worker processes, see CRTCoordinator.
+// The sampling and shading options, --aa and --threads are passed on to the workers. --progressive, --heatmap,
+// --region, --frames, --stats, --trace, --watch and --serve render in a single process only.
+// --serve keeps the scene loaded and renders the requests of clients, see CRTRenderServer.
+// --watch renders the scene again whenever the scene file is saved, until the process is stopped.
+// With --heatmap or --animation the output file name, without its extension, is the base name of the
+// heatmap or frame files
+int main(int argc, char** argv)
+{
+	if (argc > 1 && std::string(argv[1]) == "--bench")
+	{
+		return runBenchmark(argc, argv);
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--send")
+	{
+		return runClient(argc, argv);
+	}
+
+	std::string sceneFile = "Scenes/scene4_Lec12.crtscene";
+	std::string outputFile = "scene4_Lec12.ppm";
+	std::string traceFile;
+	bool statsEnabled = false;
+	bool heatmapEnabled = false;
+	bool progressiveEnabled = false;
+	CRTProgressiveSettings progressiveSettings;
+	bool adaptiveEnabled = false;
+	CRTAdaptiveSettings adaptiveSettings;
+	CRTSamplerType samplerType = CRTSamplerType::SOBOL;
+	int maxRayDepth = -1;
+	int russianRouletteDepth = -1;
+	bool singleBranchRefraction = false;
+	CRTLightSamplingSettings lightSampling;
+	bool shadowCacheEnabled = false;
+	bool shadowBatchingEnabled = false;
+	float apertureRadius = -1.f;
+	float focusDistance = -1.f;
+	float shutter = 0.f;
+	bool compactMeshesEnabled = false;
+	bool quantizePositions = false;
+	bool bvhEnabled = false;
+	CRTBVHLayout bvhLayout = CRTBVHLayout::FLOAT;
+	std::string bvhCacheDirectory;
+	bool regionEnabled = false;
+	CRTRenderRegion region;
+	CRTRegionOutput regionOutput = CRTRegionOutput::CROP;
+	bool animationEnabled = false;
+	int firstFrame = 0;
+	int frameCount = Renderer::ANIMATION_FRAME_COUNT;
+	bool coordinatorEnabled = false;
+	int serverPort = 0;
+	bool watchEnabled = false;
+	CRTCoordinatorSettings coordinatorSettings;
+	coordinatorSettings.workerExecutable = argv[0];
+	int threadCount = 0;
+	int positional = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const int argStart = i;
+		// Options of the render itself are passed on to the workers of --coordinate
+		bool isWorkerArgument = true;
+
+		if (arg == "--stats")
+		{
+			statsEnabled = true;
+			isWorkerArgument = false;
+		}
+		else if (arg == "--heatmap")
+		{
+			heatmapEnabled = true;
+			isWorkerArgument = false;
+		}
+		else if (arg == "--progressive")
+		{
+			progressiveEnabled = true;
+			isWorkerArgument = false;
+		}
+		else if (arg == "--samples" && i + 1 < argc)
+		{
+			progressiveSettings.maxSamples = std::stoi(argv[++i]);
+			isWorkerArgument = false;
+		}
+		else if (arg == "--budget" && i + 1 < argc)
+		{
+			progressiveSettings.timeBudgetSeconds = std::stof(argv[++i]);
+			isWorkerArgument = false;
+		}
+		else if (arg == "--snapshot" && i + 1 < argc)
+		{
+			progressiveSettings.snapshotSeconds = std::stof(argv[++i]);
+			isWorkerArgument = false;
+		}
+		else if (arg == "--aa")
+			adaptiveEnabled = true;
+		else if (arg == "--aa-strata" && i + 1 < argc)
+			adaptiveSettings.strataPerAxis = std::stoi(argv[++i]);
+		else if (arg == "--aa-rounds" && i + 1 < argc)
+			adaptiveSettings.maxRounds = std::stoi(argv[++i]);
+		else if (arg == "--aa-threshold" && i + 1 < argc)
+			adaptiveSettings.errorThreshold = std::stof(argv[++i]);
+		else if (arg == "--max-depth" && i + 1 < argc)
+			maxRayDepth = std::stoi(argv[++i]);
+		else if (arg == "--roulette" && i + 1 < argc)
+			russianRouletteDepth = std::stoi(argv[++i]);
+		else if (arg == "--light-samples" && i + 1 < argc)
+			lightSampling.samples = std::stoi(argv[++i]);
+		else if (arg == "--light-cull" && i + 1 < argc)
+			lightSampling.cullThreshold = std::stof(argv[++i]);
+		else if (arg == "--shadow-cache")
+			shadowCacheEnabled = true;
+		else if (arg == "--shadow-batch")
+			shadowBatchingEnabled = true;
+		else if (arg == "--aperture" && i + 1 < argc)
+			apertureRadius = std::stof(argv[++i]);
+		else if (arg == "--focus" && i + 1 < argc)
+			focusDistance = std::stof(argv[++i]);
+		else if (arg == "--shutter" && i + 1 < argc)
+			shutter = std::stof(argv[++i]);
+		else if (arg == "--compact-meshes")
+			compactMeshesEnabled = true;
+		else if (arg == "--quantize-positions")
+		{
+			compactMeshesEnabled = true;
+			quantizePositions = true;
+		}
+		else if (arg == "--bvh" && i + 1 < argc)
+		{
+			const std::string layout = argv[++i];
+			if (layout != "float" && layout != "compressed")
+			{
+				std::cout << "Unknown BVH layout " << layout << std::endl;
+				return 1;
+			}
+			bvhEnabled = true;
+			bvhLayout = layout == "compressed" ? CRTBVHLayout::COMPRESSED : CRTBVHLayout::FLOAT;
+		}
+		else if (arg == "--bvh-cache" && i + 1 < argc)
+		{
+			bvhEnabled = true;
+			bvhCacheDirectory = argv[++i];
+		}
+		else if (arg == "--region" && i + 4 < argc)
+		{
+			regionEnabled = true;
+			region.x0 = std::stoi(argv[++i]);
+			region.y0 = std::stoi(argv[++i]);
+			region.x1 = std::stoi(argv[++i]);
+			region.y1 = std::stoi(argv[++i]);
+			isWorkerArgument = false;
+		}
+		else if (arg == "--patch")
+		{
+			regionOutput = CRTRegionOutput::PATCH;
+			isWorkerArgument = false;
+		}
+		else if (arg == "--single-branch")
+			singleBranchRefraction = true;
+		else if (arg == "--sampler" && i + 1 < argc)
+		{
+			if (!CRTSampler::getType(argv[++i], samplerType))
+			{
+				std::cout << "Unknown sampler " << argv[i] << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "--threads" && i + 1 < argc)
+			threadCount = std::stoi(argv[++i]);
+		else if (arg == "--trace" && i + 1 < argc)
+		{
+			traceFile = argv[++i];
+			isWorkerArgument = false;
+		}
+		else if (arg == "--animation")
+		{
+			animationEnabled = true;
+			isWorkerArgument = false;
+		}
+		else if (arg == "--frames" && i + 2 < argc)
+		{
+			firstFrame = std::stoi(argv[++i]);
+			frameCount = std::stoi(argv[++i]);
+			isWorkerArgument = false;
+		}
+		else if (arg == "--coordinate" && i + 1 < argc)
+		{
+			coordinatorEnabled = true;
+			coordinatorSettings.workers = std::stoi(argv[++i]);
+			isWorkerArgument = false;
+		}
+		else if (arg == "--job-size" && i + 1 < argc)
+		{
+			coordinatorSettings.jobSize = std::stoi(argv[++i]);
+			isWorkerArgument = false;
+		}
+		else if (arg == "--frames-per-job" && i + 1 < argc)
+		{
+			coordinatorSettings.framesPerJob = std::stoi(argv[++i]);
+			isWorkerArgument = false;
+		}
+		else if (arg == "--attempts" && i + 1 < argc)
+		{
+			coordinatorSettings.maxAttempts = std::stoi(argv[++i]);
+			isWorkerArgument = false;
+		}
+		else if (arg == "--watch")
+		{
+			watchEnabled = true;
+			isWorkerArgument = false;
+		}
+		else if (arg == "--serve" && i + 1 < argc)
+		{
+			serverPort = std::stoi(argv[++i]);
+			isWorkerArgument = false;
+		}
+		else if (arg == "--worker" && i + 1 < argc)
+		{
+			coordinatorSettings.workerExecutable = argv[++i];
+			isWorkerArgument = false;
+		}
+		else if (positional == 0)
+		{
+			sceneFile = arg;
+			positional++;
+			isWorkerArgument = false;
+		}
+		else if (positional == 1)
+		{
+			outputFile = arg;
+			positional++;
+			isWorkerArgument = false;
+		}
+		else
+		{
+			std::cout << "Unknown option " << arg << std::endl;
+			return 1;
+		}
+
+		if (isWorkerArgument)
+		{
+			coordinatorSettings.workerArguments.insert(coordinatorSettings.workerArguments.end(),
+													   argv + argStart, argv + i + 1);
+		}
+	}
+
+#ifndef CRT_ENABLE_TIMELINE
+	if (!traceFile.empty())
+	{
+		std::cout << "Built without CRT_ENABLE_TIMELINE, no trace will be written" << std::endl;
+	}
+#endif
+
+	// The only camera motion there is to blur is the orbit of the animation
+	if (shutter > 0.f && !animationEnabled)
+	{
+		std::cout << "--shutter needs --animation" << std::endl;
+		return 1;
+	}
+
+	if (coordinatorEnabled)
+	{
+		std::string unsupported;
+		if (progressiveEnabled)
+			unsupported = "--progressive";
+		else if (heatmapEnabled)
+			unsupported = "--heatmap";
+		else if (regionEnabled || regionOutput == CRTRegionOutput::PATCH)
+			unsupported = "--region";
+		else if (firstFrame != 0 || frameCount != Renderer::ANIMATION_FRAME_COUNT)
+			unsupported = "--frames";
+		else if (statsEnabled)
+			unsupported = "--stats";
+		else if (!traceFile.empty())
+			unsupported = "--trace";
+		else if (watchEnabled)
+			unsupported = "--watch";
+		else if (serverPort > 0)
+			unsupported = "--serve";
+
+		if (!unsupported.empty())
+		{
+			std::cout << "--coordinate does not support " << unsupported << std::endl;
+			return 1;
+		}
+
+		coordinatorSettings.sampleCountImage = adaptiveEnabled && !animationEnabled;
+
+		// The workers load the scene, the coordinator only needs the image size
+		CRTSettings settings;
+		if (!CRTSceneParser::parseSettings(sceneFile, settings))
+			return 1;
+
+		CRTCoordinator coordinator(sceneFile, settings.imageWidth, settings.imageHeight, coordinatorSettings);
+		const bool succeeded = animationEnabled ?
+			coordinator.renderAnimation(outputFile.substr(0, outputFile.find_last_of('.'))) :
+			coordinator.renderScene(outputFile);
+
+		return succeeded ? 0 : 1;
+	}
+
+	CRTScene scene(sceneFile);
+
+	// Applied again after every reload of --watch
+	auto applyOverrides = [&]() {
+		if (maxRayDepth >= 0 || russianRouletteDepth >= 0)
+		{
+			CRTSettings settings = scene.getSettings();
+			if (maxRayDepth >= 0)
+				settings.maxRayDepth = maxRayDepth;
+			if (russianRouletteDepth >= 0)
+				settings.russianRouletteDepth = russianRouletteDepth;
+			scene.setSettings(settings);
+		}
+
+		if (apertureRadius >= 0.f || focusDistance > 0.f)
+		{
+			CRTCamera camera = scene.getCamera();
+			camera.setLens(apertureRadius >= 0.f ? apertureRadius : camera.getApertureRadius(),
+						   focusDistance > 0.f ? focusDistance : camera.getFocusDistance());
+			scene.setCamera(camera);
+		}
+
+		if (compactMeshesEnabled)
+		{
+			const size_t bytesBefore = scene.getMeshBytes();
+			// After a reload only the rebuilt meshes are compacted, the others already are
+			if (scene.compactMeshes(quantizePositions) > 0)
+			{
+				std::cout << "Mesh data: " << bytesBefore / (1024.0 * 1024.0) << " MB -> "
+						  << scene.getMeshBytes() / (1024.0 * 1024.0) << " MB" << std::endl;
+			}
+		}
+
+		if (bvhEnabled)
+		{
+			auto buildStart = std::chrono::steady_clock::now();
+			scene.buildBVHs(bvhLayout, bvhCacheDirectory);
+			const double buildMs =
+				std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+
+			int bvhCount = 0;
+			int mappedCount = 0;
+			for (const CRTMesh& mesh : scene.getObjects())
+			{
+				bvhCount += mesh.getBVH().isEmpty() ? 0 : 1;
+				mappedCount += mesh.getBVH().isMapped() ? 1 : 0;
+			}
+
+			std::cout << "BVH: " << scene.getBVHBytes() / (1024.0 * 1024.0) << " MB, ready in " << buildMs << " ms ("
+					  << mappedCount << " of " << bvhCount << " from cache)" << std::endl;
+		}
+	};
+	applyOverrides();
 
 	Renderer renderer(&scene);
+	renderer.setStatsEnabled(statsEnabled);
+	renderer.setThreadCount(threadCount);
+	renderer.setAdaptiveEnabled(adaptiveEnabled);
+	renderer.setAdaptiveSettings(adaptiveSettings);
+	renderer.setSamplerType(samplerType);
+	renderer.setSingleBranchRefraction(singleBranchRefraction);
+	renderer.setLightSampling(lightSampling);
+	renderer.setShadowCacheEnabled(shadowCacheEnabled);
+	renderer.setShadowBatchingEnabled(shadowBatchingEnabled);
+	renderer.setShutter(shutter);
+
+	if (watchEnabled)
+	{
+		watchScene(scene, renderer, sceneFile, outputFile, applyOverrides);
+		return 0;
+	}
+
+	if (serverPort > 0)
+	{
+		CRTRenderServer server(scene, renderer);
+		return server.run(serverPort) ? 0 : 1;
+	}
 
-	renderer.renderScene("scene4_Lec12.ppm");
+	if (heatmapEnabled)
+		renderer.renderHeatmap(outputFile.substr(0, outputFile.find_last_of('.')));
+	else if (progressiveEnabled)
+		renderer.renderProgressive(outputFile, progressiveSettings);
+	else if (animationEnabled)
+		renderer.renderAnimation(outputFile.substr(0, outputFile.find_last_of('.')), firstFrame, frameCount);
+	else if (regionEnabled)
+		renderer.renderScene(outputFile, region, regionOutput);
+	else
+		renderer.renderScene(outputFile);
 
+	if (!traceFile.empty())
+	{
+		CRT_TIMELINE_WRITE(traceFile);
+	}
 }
@@ -0,0 +1,68 @@
+#include "CRTArena.h"
+#include <algorithm>
+#include "CRTRenderStats.h"
+
+CRTArena::CRTArena(size_t blockSize) : blockSize(blockSize)
+{
+	// Taking a block should be the only heap allocation an arena makes while in use
+	blocks.reserve(16);
+}
+
+CRTArena::~CRTArena()
+{
+	for (const Block& block : blocks)
+	{
+		delete[] block.data;
+	}
+}
+
+void* CRTArena::allocate(size_t bytes, size_t alignment)
+{
+	CRTRenderStats* stats = CRTRenderStats::getThreadStats();
+	if (stats)
+	{
+		stats->arenaAllocations++;
+		stats->arenaBytes += bytes;
+	}
+
+	// The first block with room for the request, blocks after a reset are reused before new ones
+	while (currentBlock < blocks.size())
+	{
+		const Block& block = blocks[currentBlock];
+		const uintptr_t address = reinterpret_cast<uintptr_t>(block.data) + offset;
+		const size_t padding = (alignment - address % alignment) % alignment;
+
+		if (offset + padding + bytes <= block.size)
+		{
+			offset += padding + bytes;
+			return block.data + offset - bytes;
+		}
+
+		currentBlock++;
+		offset = 0;
+	}
+
+	if (stats)
+		stats->arenaBlocks++;
+
+	Block block;
+	block.size = std::max(blockSize, bytes + alignment);
+	block.data = new uint8_t[block.size];
+	blocks.push_back(block);
+
+	currentBlock = blocks.size() - 1;
+	const uintptr_t address = reinterpret_cast<uintptr_t>(block.data);
+	offset = (alignment - address % alignment) % alignment + bytes;
+	return block.data + offset - bytes;
+}
+
+CRTArena::Marker CRTArena::getMarker() const
+{
+	return { currentBlock, offset };
+}
+
+void CRTArena::resetTo(const Marker& marker)
+{
+	currentBlock = marker.block;
+	offset = marker.offset;
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator for the transient data of a render thread. Allocations are a pointer increment
+// in the current block; nothing is freed on its own, resetTo() drops everything allocated after a
+// marker and keeps the blocks for reuse. After the first tile has grown the blocks, rendering a tile
+// takes no memory from the heap. Allocations and new blocks are counted in the thread's render stats.
+class CRTArena
+{
+public:
+	struct Marker
+	{
+		size_t block;
+		size_t offset;
+	};
+
+	explicit CRTArena(size_t blockSize = 256 * 1024);
+	~CRTArena();
+
+	CRTArena(const CRTArena& other) = delete;
+	CRTArena& operator=(const CRTArena& other) = delete;
+
+	void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+	// Uninitialised storage for count objects, which the arena never destroys
+	template <typename T>
+	T* allocateArray(size_t count)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+		return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+	}
+
+	Marker getMarker() const;
+	void resetTo(const Marker& marker);
+
+private:
+	struct Block
+	{
+		uint8_t* data;
+		size_t size;
+	};
+
+	std::vector<Block> blocks;
+	size_t blockSize;
+	size_t currentBlock = 0;
+	size_t offset = 0;
+};
+
+// Growable array in an arena for trivially copyable types. Growing copies the elements to a new,
+// twice as large allocation and leaves the old one to the arena's next reset.
+template <typename T>
+class CRTArenaArray
+{
+public:
+	static_assert(std::is_trivially_copyable<T>::value, "arena arrays copy their elements with memcpy");
+
+	// Starts empty in arena, dropping what the array held before
+	void init(CRTArena* arena, size_t capacity)
+	{
+		this->arena = arena;
+		this->capacity = capacity;
+		count = 0;
+		elements = capacity > 0 ? arena->allocateArray<T>(capacity) : nullptr;
+	}
+
+	void assign(size_t newCount, const T& value)
+	{
+		if (newCount > capacity)
+			grow(newCount);
+
+		for (size_t i = 0; i < newCount; i++)
+		{
+			elements[i] = value;
+		}
+		count = newCount;
+	}
+
+	void push_back(const T& value)
+	{
+		if (count == capacity)
+			grow(capacity > 0 ? capacity * 2 : 16);
+
+		std::memcpy(&elements[count++], &value, sizeof(T));
+	}
+
+	void clear()
+	{
+		count = 0;
+	}
+
+	size_t size() const
+	{
+		return count;
+	}
+
+	T& operator[](size_t idx)
+	{
+		return elements[idx];
+	}
+
+	const T& operator[](size_t idx) const
+	{
+		return elements[idx];
+	}
+
+	T* begin()
+	{
+		return elements;
+	}
+
+	T* end()
+	{
+		return elements + count;
+	}
+
+private:
+	CRTArena* arena = nullptr;
+	T* elements = nullptr;
+	size_t count = 0;
+	size_t capacity = 0;
+
+	void grow(size_t newCapacity)
+	{
+		T* newElements = arena->allocateArray<T>(newCapacity);
+		if (count > 0)
+			std::memcpy(newElements, elements, count * sizeof(T));
+
+		elements = newElements;
+		capacity = newCapacity;
+	}
+};
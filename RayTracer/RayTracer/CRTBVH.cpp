@@ -0,0 +1,875 @@
+#include "CRTBVH.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include "CRTRandom.h"
+#include "CRTTriangleKernels.h"
+
+static const int BIN_COUNT = 12;
+// Cost of visiting a node relative to testing one triangle
+static const float TRAVERSAL_COST = 1.f;
+// From this depth on the split is always at the median, which keeps the traversal stack bounded
+static const int MAX_SAH_DEPTH = 32;
+static const int STACK_SIZE = 64;
+
+static const char CACHE_MAGIC[8] = { 'C', 'R', 'T', 'B', 'V', 'H', '\0', '\0' };
+// Bump whenever the build or the file layout changes, old cache files then stop matching
+static const uint32_t CACHE_VERSION = 2;
+// Sections start on this boundary so the mapped arrays can be read in place
+static const size_t CACHE_ALIGNMENT = 16;
+
+struct CRTBVHCacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t layout;
+	uint64_t key;
+	// Checked on load, so a key collision cannot hand a mesh the hierarchy of another one
+	uint64_t checksum;
+	uint32_t nodeSize;
+	uint32_t compressedNodeSize;
+	uint64_t nodeCount;
+	uint64_t triangleIndexCount;
+	uint64_t compressedNodeCount;
+	uint64_t packedTriangleIndexCount;
+	uint32_t packedIndexSize;
+	int32_t rootTriangleCount;
+	float rootMin[3];
+	float rootMax[3];
+};
+
+static size_t alignCacheOffset(size_t offset)
+{
+	return (offset + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+}
+
+// Where the nodes, triangle indices, compressed nodes and packed triangle indices start and how many
+// bytes they take, returns the file size
+static size_t getCacheSections(const CRTBVHCacheHeader& header, size_t offsets[4], size_t sectionSizes[4])
+{
+	sectionSizes[0] = header.nodeCount * header.nodeSize;
+	sectionSizes[1] = header.triangleIndexCount * sizeof(int);
+	sectionSizes[2] = header.compressedNodeCount * header.compressedNodeSize;
+	sectionSizes[3] = header.packedTriangleIndexCount * header.packedIndexSize;
+
+	size_t offset = sizeof(CRTBVHCacheHeader);
+	for (int section = 0; section < 4; section++)
+	{
+		offset = alignCacheOffset(offset);
+		offsets[section] = offset;
+		offset += sectionSizes[section];
+	}
+
+	return offset;
+}
+
+// 64-bit words, the tail padded with zeros, each mixed through CRTRandom::hash so that changes in
+// different words cannot cancel out
+static uint64_t hashBytes(const void* data, size_t size, uint64_t hash)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+	for (size_t i = 0; i < size; i += sizeof(uint64_t))
+	{
+		uint64_t word = 0;
+		std::memcpy(&word, bytes + i, std::min(sizeof(uint64_t), size - i));
+		hash = CRTRandom::hash(hash ^ word);
+	}
+
+	return hash;
+}
+
+// FNV-1a byte by byte, independent of hashBytes
+static uint64_t checksumBytes(const void* data, size_t size, uint64_t checksum)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+	for (size_t i = 0; i < size; i++)
+	{
+		checksum ^= bytes[i];
+		checksum *= 1099511628211ull;
+	}
+
+	return checksum;
+}
+
+static float getHalfArea(const float* boundsMin, const float* boundsMax)
+{
+	const float dx = boundsMax[0] - boundsMin[0];
+	const float dy = boundsMax[1] - boundsMin[1];
+	const float dz = boundsMax[2] - boundsMin[2];
+	return dx * dy + dy * dz + dz * dx;
+}
+
+static void resetBounds(float* boundsMin, float* boundsMax)
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		boundsMin[axis] = std::numeric_limits<float>::infinity();
+		boundsMax[axis] = -std::numeric_limits<float>::infinity();
+	}
+}
+
+static void growBounds(float* boundsMin, float* boundsMax, const float* otherMin, const float* otherMax)
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		boundsMin[axis] = std::min(boundsMin[axis], otherMin[axis]);
+		boundsMax[axis] = std::max(boundsMax[axis], otherMax[axis]);
+	}
+}
+
+// Slab test, tEntry receives where the ray enters the box
+static bool intersectBox(const float* boundsMin, const float* boundsMax, const float* origin,
+						 const float* invDirection, float maxT, float& tEntry)
+{
+	float tNear = 0.f;
+	float tFar = maxT;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float t0 = (boundsMin[axis] - origin[axis]) * invDirection[axis];
+		float t1 = (boundsMax[axis] - origin[axis]) * invDirection[axis];
+		if (t0 > t1)
+			std::swap(t0, t1);
+
+		// A NaN from a ray in the plane of a slab leaves the interval as it is
+		tNear = std::max(tNear, t0);
+		tFar = std::min(tFar, t1);
+	}
+
+	tEntry = tNear;
+	return tNear <= tFar;
+}
+
+// Smallest power-of-two step that covers [boxMin, boxMax] in 255 steps
+static int getQuantizationExponent(float boxMin, float boxMax)
+{
+	const float extent = boxMax - boxMin;
+	int exponent = -126;
+	if (extent > 0.f)
+	{
+		std::frexp(extent / 255.f, &exponent);
+		exponent = std::max(exponent, -126);
+	}
+
+	while (exponent < 127 && boxMin + 255.f * std::ldexp(1.f, exponent) < boxMax)
+	{
+		exponent++;
+	}
+
+	return exponent;
+}
+
+void CRTBVH::build(const CRTTriangleStream& stream, CRTBVHLayout layout)
+{
+	clear();
+	this->layout = layout;
+
+	std::vector<BuildTriangle> triangles;
+	triangles.reserve(stream.getTriangleCount());
+
+	for (size_t i = 0; i < stream.getTriangleCount(); i++)
+	{
+		CRTVector v0(stream.getV0(0)[i], stream.getV0(1)[i], stream.getV0(2)[i]);
+		CRTVector e1(stream.getE1(0)[i], stream.getE1(1)[i], stream.getE1(2)[i]);
+		CRTVector e2(stream.getE2(0)[i], stream.getE2(1)[i], stream.getE2(2)[i]);
+
+		// Degenerate lanes of the stream can never be hit
+		const float shortestEdge = std::min(std::min(e1.length(), e2.length()), (e2 - e1).length());
+		if (!(shortestEdge > 0.f))
+			continue;
+
+		CRTVector v1 = v0 + e1;
+		CRTVector v2 = v0 + e2;
+
+		BuildTriangle triangle;
+		triangle.index = static_cast<int>(i);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const float a = v0.getByIndex(axis);
+			const float b = v1.getByIndex(axis);
+			const float c = v2.getByIndex(axis);
+			const float largest = std::max(std::abs(a), std::max(std::abs(b), std::abs(c)));
+
+			// The kernels accept hits slightly outside the edges, by up to the edge tolerance over the edge length
+			const float padding = -CRTTriangleKernels::EDGE_EPSILON / shortestEdge + 1e-6f * (1.f + largest);
+			triangle.boundsMin[axis] = std::min(a, std::min(b, c)) - padding;
+			triangle.boundsMax[axis] = std::max(a, std::max(b, c)) + padding;
+			triangle.centroid[axis] = 0.5f * (triangle.boundsMin[axis] + triangle.boundsMax[axis]);
+		}
+		triangles.push_back(triangle);
+	}
+
+	if (triangles.empty())
+		return;
+
+	nodes.reserve(2 * triangles.size() - 1);
+	buildNode(triangles, 0, static_cast<int>(triangles.size()), 0);
+
+	triangleIndices.reserve(triangles.size());
+	for (const BuildTriangle& triangle : triangles)
+	{
+		triangleIndices.push_back(triangle.index);
+	}
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		rootMin[axis] = nodes[0].boundsMin[axis];
+		rootMax[axis] = nodes[0].boundsMax[axis];
+	}
+
+	if (layout == CRTBVHLayout::COMPRESSED)
+	{
+		compress();
+	}
+}
+
+void CRTBVH::clear()
+{
+	nodes.clear();
+	triangleIndices.clear();
+	compressedNodes.clear();
+	packedTriangleIndices16.clear();
+	packedTriangleIndices32.clear();
+	rootTriangleCount = 0;
+	mapping.reset();
+	mappedView = View();
+}
+
+bool CRTBVH::isEmpty() const
+{
+	const View view = getView();
+	return view.nodeCount == 0 && view.compressedNodeCount == 0 && rootTriangleCount == 0;
+}
+
+CRTBVHLayout CRTBVH::getLayout() const
+{
+	return layout;
+}
+
+bool CRTBVH::isMapped() const
+{
+	return mapping != nullptr;
+}
+
+size_t CRTBVH::getNodeCount() const
+{
+	const View view = getView();
+	return layout == CRTBVHLayout::COMPRESSED ? view.compressedNodeCount : view.nodeCount;
+}
+
+size_t CRTBVH::getMemoryBytes() const
+{
+	const View view = getView();
+
+	if (layout == CRTBVHLayout::COMPRESSED)
+	{
+		const size_t indexSize = view.packedTriangleIndices32 ? sizeof(uint32_t) : sizeof(uint16_t);
+		return view.compressedNodeCount * sizeof(CompressedNode) + view.packedTriangleIndexCount * indexSize +
+			   sizeof(rootMin) + sizeof(rootMax);
+	}
+
+	return view.nodeCount * sizeof(Node) + view.triangleIndexCount * sizeof(int);
+}
+
+CRTBVH::View CRTBVH::getView() const
+{
+	if (mapping)
+		return mappedView;
+
+	View view;
+	view.nodes = nodes.data();
+	view.nodeCount = nodes.size();
+	view.triangleIndices = triangleIndices.data();
+	view.triangleIndexCount = triangleIndices.size();
+	view.compressedNodes = compressedNodes.data();
+	view.compressedNodeCount = compressedNodes.size();
+	if (!packedTriangleIndices32.empty())
+	{
+		view.packedTriangleIndices32 = packedTriangleIndices32.data();
+		view.packedTriangleIndexCount = packedTriangleIndices32.size();
+	}
+	else
+	{
+		view.packedTriangleIndices16 = packedTriangleIndices16.data();
+		view.packedTriangleIndexCount = packedTriangleIndices16.size();
+	}
+
+	return view;
+}
+
+int CRTBVH::buildNode(std::vector<BuildTriangle>& triangles, int begin, int end, int depth)
+{
+	const int nodeIdx = static_cast<int>(nodes.size());
+	nodes.push_back(Node());
+
+	Node node;
+	float centroidMin[3];
+	float centroidMax[3];
+	resetBounds(node.boundsMin, node.boundsMax);
+	resetBounds(centroidMin, centroidMax);
+
+	for (int i = begin; i < end; i++)
+	{
+		growBounds(node.boundsMin, node.boundsMax, triangles[i].boundsMin, triangles[i].boundsMax);
+		growBounds(centroidMin, centroidMax, triangles[i].centroid, triangles[i].centroid);
+	}
+
+	const int count = end - begin;
+	const float leafCost = static_cast<float>(count);
+
+	int splitAxis = -1;
+	int splitBin = 0;
+	float splitCost = std::numeric_limits<float>::infinity();
+
+	if (depth < MAX_SAH_DEPTH)
+	{
+		const float nodeArea = getHalfArea(node.boundsMin, node.boundsMax);
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const float extent = centroidMax[axis] - centroidMin[axis];
+			if (!(extent > 0.f))
+				continue;
+
+			float binMin[BIN_COUNT][3];
+			float binMax[BIN_COUNT][3];
+			int binCount[BIN_COUNT] = {};
+			for (int bin = 0; bin < BIN_COUNT; bin++)
+			{
+				resetBounds(binMin[bin], binMax[bin]);
+			}
+
+			const float binScale = BIN_COUNT / extent;
+			for (int i = begin; i < end; i++)
+			{
+				const int bin = std::min(static_cast<int>((triangles[i].centroid[axis] - centroidMin[axis]) * binScale),
+										 BIN_COUNT - 1);
+				binCount[bin]++;
+				growBounds(binMin[bin], binMax[bin], triangles[i].boundsMin, triangles[i].boundsMax);
+			}
+
+			// Areas and counts left of every split plane, swept from the left, then the right side from the right
+			float leftArea[BIN_COUNT - 1];
+			int leftCount[BIN_COUNT - 1];
+			float sweepMin[3];
+			float sweepMax[3];
+			int sweepCount = 0;
+			resetBounds(sweepMin, sweepMax);
+			for (int bin = 0; bin < BIN_COUNT - 1; bin++)
+			{
+				growBounds(sweepMin, sweepMax, binMin[bin], binMax[bin]);
+				sweepCount += binCount[bin];
+				leftArea[bin] = sweepCount > 0 ? getHalfArea(sweepMin, sweepMax) : 0.f;
+				leftCount[bin] = sweepCount;
+			}
+
+			resetBounds(sweepMin, sweepMax);
+			sweepCount = 0;
+			for (int bin = BIN_COUNT - 1; bin > 0; bin--)
+			{
+				growBounds(sweepMin, sweepMax, binMin[bin], binMax[bin]);
+				sweepCount += binCount[bin];
+
+				if (leftCount[bin - 1] == 0 || sweepCount == 0)
+					continue;
+
+				const float cost = TRAVERSAL_COST + (leftArea[bin - 1] * leftCount[bin - 1] +
+													 getHalfArea(sweepMin, sweepMax) * sweepCount) / nodeArea;
+				if (cost < splitCost)
+				{
+					splitCost = cost;
+					splitAxis = axis;
+					splitBin = bin;
+				}
+			}
+		}
+	}
+
+	if (count <= MAX_LEAF_SIZE && (count == 1 || splitCost >= leafCost))
+	{
+		node.child = -(begin + 1);
+		node.triangleCount = count;
+		nodes[nodeIdx] = node;
+		return nodeIdx;
+	}
+
+	int middle;
+	if (splitAxis >= 0)
+	{
+		const float binScale = BIN_COUNT / (centroidMax[splitAxis] - centroidMin[splitAxis]);
+		auto splitIt = std::partition(triangles.begin() + begin, triangles.begin() + end, [&](const BuildTriangle& triangle) {
+			const int bin = std::min(static_cast<int>((triangle.centroid[splitAxis] - centroidMin[splitAxis]) * binScale),
+									 BIN_COUNT - 1);
+			return bin < splitBin;
+		});
+		middle = static_cast<int>(splitIt - triangles.begin());
+	}
+	else
+	{
+		// No usable plane, or too deep: halve at the median of the widest centroid axis
+		int widestAxis = 0;
+		for (int axis = 1; axis < 3; axis++)
+		{
+			if (centroidMax[axis] - centroidMin[axis] > centroidMax[widestAxis] - centroidMin[widestAxis])
+				widestAxis = axis;
+		}
+
+		middle = begin + count / 2;
+		std::nth_element(triangles.begin() + begin, triangles.begin() + middle, triangles.begin() + end,
+			[&](const BuildTriangle& lhs, const BuildTriangle& rhs) {
+				return lhs.centroid[widestAxis] < rhs.centroid[widestAxis];
+			});
+	}
+
+	buildNode(triangles, begin, middle, depth + 1);
+	node.child = buildNode(triangles, middle, end, depth + 1);
+	node.triangleCount = 0;
+	nodes[nodeIdx] = node;
+
+	return nodeIdx;
+}
+
+void CRTBVH::compress()
+{
+	// The entries are stream indices, degenerate triangles left out of the BVH still count
+	const int maxIndex = triangleIndices.empty() ? 0 : *std::max_element(triangleIndices.begin(), triangleIndices.end());
+	if (maxIndex <= std::numeric_limits<uint16_t>::max())
+		packedTriangleIndices16.assign(triangleIndices.begin(), triangleIndices.end());
+	else
+		packedTriangleIndices32.assign(triangleIndices.begin(), triangleIndices.end());
+
+	if (nodes[0].child < 0)
+	{
+		rootTriangleCount = nodes[0].triangleCount;
+	}
+	else
+	{
+		compressedNodes.reserve(nodes.size() / 2);
+		compressNode(0, rootMin, rootMax);
+	}
+
+	// swap() releases the memory, clear() would keep it
+	std::vector<Node>().swap(nodes);
+	std::vector<int>().swap(triangleIndices);
+}
+
+void CRTBVH::compressNode(int nodeIdx, const float* boxMin, const float* boxMax)
+{
+	const int compressedIdx = static_cast<int>(compressedNodes.size());
+	compressedNodes.push_back(CompressedNode());
+
+	CompressedNode compressed;
+	compressed.leafInfo = 0;
+
+	float scale[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		compressed.exponent[axis] = static_cast<int8_t>(getQuantizationExponent(boxMin[axis], boxMax[axis]));
+		scale[axis] = std::ldexp(1.f, compressed.exponent[axis]);
+	}
+
+	const int childIdx[2] = { nodeIdx + 1, nodes[nodeIdx].child };
+	float childMin[2][3];
+	float childMax[2][3];
+
+	for (int c = 0; c < 2; c++)
+	{
+		const Node& child = nodes[childIdx[c]];
+
+		// Rounded outwards and checked against the decoded value, so the decoded box always holds the child
+		for (int axis = 0; axis < 3; axis++)
+		{
+			int qMin = static_cast<int>(std::floor((child.boundsMin[axis] - boxMin[axis]) / scale[axis]));
+			qMin = std::min(std::max(qMin, 0), 255);
+			while (qMin > 0 && boxMin[axis] + qMin * scale[axis] > child.boundsMin[axis])
+				qMin--;
+
+			int qMax = static_cast<int>(std::ceil((child.boundsMax[axis] - boxMin[axis]) / scale[axis]));
+			qMax = std::min(std::max(qMax, qMin), 255);
+			while (qMax < 255 && boxMin[axis] + qMax * scale[axis] < child.boundsMax[axis])
+				qMax++;
+
+			compressed.quantizedMin[c][axis] = static_cast<uint8_t>(qMin);
+			compressed.quantizedMax[c][axis] = static_cast<uint8_t>(qMax);
+			childMin[c][axis] = boxMin[axis] + qMin * scale[axis];
+			childMax[c][axis] = boxMin[axis] + qMax * scale[axis];
+		}
+
+		if (child.child < 0)
+		{
+			compressed.leafInfo |= static_cast<uint8_t>((1 << c) | ((child.triangleCount - 1) << (2 + 3 * c)));
+			compressed.child[c] = static_cast<uint32_t>(-child.child - 1);
+		}
+	}
+
+	// The left child, when it is an inner node, is the next one written
+	if (nodes[childIdx[0]].child >= 0)
+	{
+		compressed.child[0] = static_cast<uint32_t>(compressedNodes.size());
+		compressNode(childIdx[0], childMin[0], childMax[0]);
+	}
+
+	if (nodes[childIdx[1]].child >= 0)
+	{
+		compressed.child[1] = static_cast<uint32_t>(compressedNodes.size());
+		compressNode(childIdx[1], childMin[1], childMax[1]);
+	}
+
+	compressedNodes[compressedIdx] = compressed;
+}
+
+int CRTBVH::getPackedTriangleIndex(const View& view, size_t i)
+{
+	return view.packedTriangleIndices32 ? static_cast<int>(view.packedTriangleIndices32[i]) : view.packedTriangleIndices16[i];
+}
+
+int CRTBVH::intersect(const CRTTriangleStream& stream, const CRTRay& ray, float maxT, float& closestT, bool anyHit,
+					  long long& boxTests, long long& triangleTests) const
+{
+	if (layout == CRTBVHLayout::COMPRESSED)
+		return intersectCompressed(stream, ray, maxT, closestT, anyHit, boxTests, triangleTests);
+
+	return intersectFloat(stream, ray, maxT, closestT, anyHit, boxTests, triangleTests);
+}
+
+// Tests the leaf triangles first to first + count, getIndex maps a leaf entry to its stream index.
+// Returns true when an any-hit query can stop.
+template <typename GetIndex>
+static bool intersectLeaf(const CRTTriangleStream& stream, const CRTRay& ray, float maxT, float& closestT,
+						  bool anyHit, int& closestIdx, long long& triangleTests, size_t first, int count,
+						  GetIndex getIndex)
+{
+	triangleTests += count;
+
+	for (size_t i = first; i < first + count; i++)
+	{
+		const int triangleIdx = getIndex(i);
+
+		float t;
+		if (!CRTTriangleKernels::intersectOne(stream, triangleIdx, ray, maxT, t))
+			continue;
+
+		// Ties go to the lowest stream index like in the stream kernels, hits of earlier meshes keep theirs
+		if (t < closestT || (closestIdx >= 0 && t == closestT && triangleIdx < closestIdx))
+		{
+			closestT = t;
+			closestIdx = triangleIdx;
+			if (anyHit)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+int CRTBVH::intersectFloat(const CRTTriangleStream& stream, const CRTRay& ray, float maxT, float& closestT,
+						   bool anyHit, long long& boxTests, long long& triangleTests) const
+{
+	const View view = getView();
+	if (view.nodeCount == 0)
+		return -1;
+
+	const float origin[3] = { ray.getOrigin().getX(), ray.getOrigin().getY(), ray.getOrigin().getZ() };
+	const float invDirection[3] = { 1.f / ray.getDirection().getX(), 1.f / ray.getDirection().getY(),
+									1.f / ray.getDirection().getZ() };
+	auto getIndex = [&view](size_t i) { return view.triangleIndices[i]; };
+
+	int closestIdx = -1;
+
+	struct StackEntry
+	{
+		int nodeIdx;
+		float tEntry;
+	};
+	StackEntry stack[STACK_SIZE];
+	int stackSize = 0;
+
+	float tEntry;
+	boxTests++;
+	if (!intersectBox(view.nodes[0].boundsMin, view.nodes[0].boundsMax, origin, invDirection, std::min(maxT, closestT), tEntry))
+		return -1;
+	stack[stackSize++] = { 0, tEntry };
+
+	while (stackSize > 0)
+	{
+		const StackEntry entry = stack[--stackSize];
+		// A hit found since the node was pushed can make it too far
+		if (entry.tEntry > closestT)
+			continue;
+
+		const Node& node = view.nodes[entry.nodeIdx];
+
+		if (node.child < 0)
+		{
+			if (intersectLeaf(stream, ray, maxT, closestT, anyHit, closestIdx, triangleTests, -node.child - 1,
+							  node.triangleCount, getIndex))
+				return closestIdx;
+			continue;
+		}
+
+		const int childIdx[2] = { entry.nodeIdx + 1, node.child };
+		float childT[2];
+		bool childHit[2];
+		for (int c = 0; c < 2; c++)
+		{
+			const Node& child = view.nodes[childIdx[c]];
+			childHit[c] = intersectBox(child.boundsMin, child.boundsMax, origin, invDirection,
+									   std::min(maxT, closestT), childT[c]);
+		}
+		boxTests += 2;
+
+		// The nearer child is pushed last so it is visited first
+		const int nearer = childHit[1] && (!childHit[0] || childT[1] < childT[0]) ? 1 : 0;
+		if (childHit[1 - nearer])
+			stack[stackSize++] = { childIdx[1 - nearer], childT[1 - nearer] };
+		if (childHit[nearer])
+			stack[stackSize++] = { childIdx[nearer], childT[nearer] };
+	}
+
+	return closestIdx;
+}
+
+int CRTBVH::intersectCompressed(const CRTTriangleStream& stream, const CRTRay& ray, float maxT, float& closestT,
+								bool anyHit, long long& boxTests, long long& triangleTests) const
+{
+	const View view = getView();
+	if (view.compressedNodeCount == 0 && rootTriangleCount == 0)
+		return -1;
+
+	const float origin[3] = { ray.getOrigin().getX(), ray.getOrigin().getY(), ray.getOrigin().getZ() };
+	const float invDirection[3] = { 1.f / ray.getDirection().getX(), 1.f / ray.getDirection().getY(),
+									1.f / ray.getDirection().getZ() };
+	auto getIndex = [&view](size_t i) { return getPackedTriangleIndex(view, i); };
+
+	int closestIdx = -1;
+
+	float tEntry;
+	boxTests++;
+	if (!intersectBox(rootMin, rootMax, origin, invDirection, std::min(maxT, closestT), tEntry))
+		return -1;
+
+	if (view.compressedNodeCount == 0)
+	{
+		intersectLeaf(stream, ray, maxT, closestT, anyHit, closestIdx, triangleTests, 0, rootTriangleCount, getIndex);
+		return closestIdx;
+	}
+
+	// An inner node's bounds are not stored, its entry carries the minimum its parent decoded for it
+	struct StackEntry
+	{
+		int nodeIdx;
+		float tEntry;
+		float boxMin[3];
+	};
+	StackEntry stack[STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = { 0, tEntry, { rootMin[0], rootMin[1], rootMin[2] } };
+
+	while (stackSize > 0)
+	{
+		const StackEntry entry = stack[--stackSize];
+		if (entry.tEntry > closestT)
+			continue;
+
+		const CompressedNode& node = view.compressedNodes[entry.nodeIdx];
+
+		float childMin[2][3];
+		float childMax[2][3];
+		float childT[2];
+		bool childHit[2];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const float scale = std::ldexp(1.f, node.exponent[axis]);
+			for (int c = 0; c < 2; c++)
+			{
+				childMin[c][axis] = entry.boxMin[axis] + node.quantizedMin[c][axis] * scale;
+				childMax[c][axis] = entry.boxMin[axis] + node.quantizedMax[c][axis] * scale;
+			}
+		}
+
+		for (int c = 0; c < 2; c++)
+		{
+			childHit[c] = intersectBox(childMin[c], childMax[c], origin, invDirection, std::min(maxT, closestT), childT[c]);
+		}
+		boxTests += 2;
+
+		// Leaves are tested right away, nearer one first, inner nodes go on the stack
+		const int nearer = childHit[1] && (!childHit[0] || childT[1] < childT[0]) ? 1 : 0;
+		for (int c : { nearer, 1 - nearer })
+		{
+			if (!childHit[c] || !(node.leafInfo & (1 << c)) || childT[c] > closestT)
+				continue;
+
+			const int count = ((node.leafInfo >> (2 + 3 * c)) & 7) + 1;
+			if (intersectLeaf(stream, ray, maxT, closestT, anyHit, closestIdx, triangleTests, node.child[c], count,
+							  getIndex))
+				return closestIdx;
+		}
+
+		for (int c : { 1 - nearer, nearer })
+		{
+			if (!childHit[c] || (node.leafInfo & (1 << c)))
+				continue;
+
+			stack[stackSize++] = { static_cast<int>(node.child[c]), childT[c],
+								   { childMin[c][0], childMin[c][1], childMin[c][2] } };
+		}
+	}
+
+	return closestIdx;
+}
+
+uint64_t CRTBVH::getCacheKey(const CRTTriangleStream& stream, CRTBVHLayout layout)
+{
+	float traversalCost = TRAVERSAL_COST;
+	float edgeEpsilon = CRTTriangleKernels::EDGE_EPSILON;
+	uint32_t traversalCostBits;
+	uint32_t edgeEpsilonBits;
+	std::memcpy(&traversalCostBits, &traversalCost, sizeof(float));
+	std::memcpy(&edgeEpsilonBits, &edgeEpsilon, sizeof(float));
+
+	const uint64_t parameters[] = { CACHE_VERSION, static_cast<uint64_t>(layout), MAX_LEAF_SIZE, BIN_COUNT,
+									MAX_SAH_DEPTH, traversalCostBits, edgeEpsilonBits, stream.getTriangleCount() };
+
+	uint64_t hash = hashBytes(parameters, sizeof(parameters), 0);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		hash = hashBytes(stream.getV0(axis), stream.getTriangleCount() * sizeof(float), hash);
+		hash = hashBytes(stream.getE1(axis), stream.getTriangleCount() * sizeof(float), hash);
+		hash = hashBytes(stream.getE2(axis), stream.getTriangleCount() * sizeof(float), hash);
+	}
+
+	return hash;
+}
+
+uint64_t CRTBVH::getCacheChecksum(const CRTTriangleStream& stream)
+{
+	const uint64_t triangleCount = stream.getTriangleCount();
+	uint64_t checksum = checksumBytes(&triangleCount, sizeof(triangleCount), 14695981039346656037ull);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		checksum = checksumBytes(stream.getV0(axis), stream.getTriangleCount() * sizeof(float), checksum);
+		checksum = checksumBytes(stream.getE1(axis), stream.getTriangleCount() * sizeof(float), checksum);
+		checksum = checksumBytes(stream.getE2(axis), stream.getTriangleCount() * sizeof(float), checksum);
+	}
+
+	return checksum;
+}
+
+bool CRTBVH::saveCache(const std::string& fileName, uint64_t key, uint64_t checksum) const
+{
+	if (isEmpty())
+		return false;
+
+	const View view = getView();
+
+	CRTBVHCacheHeader header = {};
+	std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.layout = static_cast<uint32_t>(layout);
+	header.key = key;
+	header.checksum = checksum;
+	header.nodeSize = sizeof(Node);
+	header.compressedNodeSize = sizeof(CompressedNode);
+	header.nodeCount = view.nodeCount;
+	header.triangleIndexCount = view.triangleIndexCount;
+	header.compressedNodeCount = view.compressedNodeCount;
+	header.packedTriangleIndexCount = view.packedTriangleIndexCount;
+	header.packedIndexSize = view.packedTriangleIndices32 ? sizeof(uint32_t) : sizeof(uint16_t);
+	header.rootTriangleCount = rootTriangleCount;
+	std::memcpy(header.rootMin, rootMin, sizeof(rootMin));
+	std::memcpy(header.rootMax, rootMax, sizeof(rootMax));
+
+	size_t offsets[4];
+	size_t sectionSizes[4];
+	const size_t fileSize = getCacheSections(header, offsets, sectionSizes);
+	const void* sections[4] = {
+		view.nodes,
+		view.triangleIndices,
+		view.compressedNodes,
+		view.packedTriangleIndices32 ? static_cast<const void*>(view.packedTriangleIndices32) : view.packedTriangleIndices16
+	};
+
+	const std::string tempName = fileName + "." +
+		std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".tmp";
+	{
+		std::ofstream ofs(tempName, std::ios::binary);
+		ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		size_t written = sizeof(header);
+		for (int section = 0; section < 4; section++)
+		{
+			const std::string padding(offsets[section] - written, '\0');
+			ofs.write(padding.data(), padding.size());
+			if (sectionSizes[section] > 0)
+				ofs.write(static_cast<const char*>(sections[section]), sectionSizes[section]);
+			written = offsets[section] + sectionSizes[section];
+		}
+
+		if (!ofs || written != fileSize)
+		{
+			ofs.close();
+			std::filesystem::remove(tempName);
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempName, fileName, error);
+	if (error)
+	{
+		std::filesystem::remove(tempName, error);
+		return false;
+	}
+
+	return true;
+}
+
+bool CRTBVH::loadCache(const std::string& fileName, uint64_t key, uint64_t checksum)
+{
+	std::shared_ptr<CRTMappedFile> file = std::make_shared<CRTMappedFile>();
+	if (!file->open(fileName) || file->getSize() < sizeof(CRTBVHCacheHeader))
+		return false;
+
+	CRTBVHCacheHeader header;
+	std::memcpy(&header, file->getData(), sizeof(header));
+
+	if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != CACHE_VERSION ||
+		header.key != key || header.checksum != checksum || header.nodeSize != sizeof(Node) || header.compressedNodeSize != sizeof(CompressedNode) ||
+		header.layout > static_cast<uint32_t>(CRTBVHLayout::COMPRESSED) ||
+		(header.packedIndexSize != sizeof(uint16_t) && header.packedIndexSize != sizeof(uint32_t)))
+		return false;
+
+	size_t offsets[4];
+	size_t sectionSizes[4];
+	if (getCacheSections(header, offsets, sectionSizes) > file->getSize())
+		return false;
+
+	clear();
+	layout = static_cast<CRTBVHLayout>(header.layout);
+	rootTriangleCount = header.rootTriangleCount;
+	std::memcpy(rootMin, header.rootMin, sizeof(rootMin));
+	std::memcpy(rootMax, header.rootMax, sizeof(rootMax));
+
+	const unsigned char* data = file->getData();
+	mappedView.nodes = reinterpret_cast<const Node*>(data + offsets[0]);
+	mappedView.nodeCount = header.nodeCount;
+	mappedView.triangleIndices = reinterpret_cast<const int*>(data + offsets[1]);
+	mappedView.triangleIndexCount = header.triangleIndexCount;
+	mappedView.compressedNodes = reinterpret_cast<const CompressedNode*>(data + offsets[2]);
+	mappedView.compressedNodeCount = header.compressedNodeCount;
+	if (header.packedIndexSize == sizeof(uint32_t))
+		mappedView.packedTriangleIndices32 = reinterpret_cast<const uint32_t*>(data + offsets[3]);
+	else
+		mappedView.packedTriangleIndices16 = reinterpret_cast<const uint16_t*>(data + offsets[3]);
+	mappedView.packedTriangleIndexCount = header.packedTriangleIndexCount;
+	mapping = file;
+
+	return true;
+}
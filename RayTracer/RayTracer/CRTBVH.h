@@ -0,0 +1,134 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "CRTMappedFile.h"
+#include "CRTTriangleStream.h"
+#include "Math/CRTRay.h"
+
+enum class CRTBVHLayout
+{
+	FLOAT, //32-byte nodes with float bounds
+	COMPRESSED //24-byte nodes holding both children, bounds quantized to 8 bits relative to the node
+};
+
+// Bounding volume hierarchy over the triangles of one mesh's triangle stream, built with a binned
+// surface area heuristic. Leaves hold at most MAX_LEAF_SIZE triangles, tested one by one with the
+// same tests as the stream kernels, so a hit is the one a kernel over the whole stream would find.
+//
+// The compressed layout stores only inner nodes. Each keeps the bounds of its two children as
+// 8-bit offsets on a power-of-two grid over its own box, which is known from its parent during
+// traversal, and leaf triangle indices take 16 bits when the mesh is small enough.
+class CRTBVH
+{
+public:
+	static constexpr int MAX_LEAF_SIZE = 8;
+	// Smaller meshes are faster to test with the SIMD stream kernels
+	static constexpr size_t MIN_TRIANGLES = 32;
+
+	void build(const CRTTriangleStream& stream, CRTBVHLayout layout);
+	void clear();
+
+	bool isEmpty() const;
+	CRTBVHLayout getLayout() const;
+	// True when the hierarchy is read from a mapped cache file
+	bool isMapped() const;
+	size_t getNodeCount() const;
+	// Bytes of the nodes, the root bounds and the leaf triangle indices
+	size_t getMemoryBytes() const;
+
+	// Accepts, like the stream kernels, only hits in [0, maxT] closer than closestT and returns the
+	// stream index of the closest one, lowest index on ties, or -1. With anyHit the first hit found is returned.
+	// The tests made are added to boxTests and triangleTests.
+	int intersect(const CRTTriangleStream& stream, const CRTRay& ray, float maxT, float& closestT, bool anyHit,
+				  long long& boxTests, long long& triangleTests) const;
+
+	// Hash of the triangles and of everything that shapes the hierarchy built over them,
+	// a cache file holds the hierarchy of exactly one key
+	static uint64_t getCacheKey(const CRTTriangleStream& stream, CRTBVHLayout layout);
+	// Second hash of the triangles, computed differently from the key, that a cache file must match as well
+	static uint64_t getCacheChecksum(const CRTTriangleStream& stream);
+
+	// Writes the hierarchy to a cache file. The file is written under a temporary name and renamed,
+	// so processes sharing the cache never see half of it.
+	bool saveCache(const std::string& fileName, uint64_t key, uint64_t checksum) const;
+	// Maps a cache file written for key and checksum and uses it in place, false when it is missing or stale
+	bool loadCache(const std::string& fileName, uint64_t key, uint64_t checksum);
+
+private:
+	struct Node
+	{
+		float boundsMin[3];
+		float boundsMax[3];
+		// Inner nodes: index of the right child, the left one follows the node.
+		// Leaves: first entry in triangleIndices, stored as -(first + 1)
+		int child;
+		int triangleCount;
+	};
+
+	struct CompressedNode
+	{
+		// Child bounds are boxMin + quantized * 2^exponent, boxMin being this node's decoded minimum
+		int8_t exponent[3];
+		// Bit c is set when child c is a leaf, bits 2-4 and 5-7 hold the triangle counts - 1
+		uint8_t leafInfo;
+		uint8_t quantizedMin[2][3];
+		uint8_t quantizedMax[2][3];
+		// Leaf: first entry in the triangle indices. Inner node: index of the node, the left one
+		// always follows its parent and only the right one is stored
+		uint32_t child[2];
+	};
+
+	CRTBVHLayout layout = CRTBVHLayout::FLOAT;
+	std::vector<Node> nodes;
+	std::vector<int> triangleIndices;
+
+	std::vector<CompressedNode> compressedNodes;
+	std::vector<uint16_t> packedTriangleIndices16;
+	std::vector<uint32_t> packedTriangleIndices32;
+	float rootMin[3] = { 0.f, 0.f, 0.f };
+	float rootMax[3] = { 0.f, 0.f, 0.f };
+	// Triangles of a root that is a single leaf, the compressed layout then has no nodes
+	int rootTriangleCount = 0;
+
+	// The arrays the traversal reads: the vectors of a built hierarchy or the sections of a mapped cache file
+	struct View
+	{
+		const Node* nodes = nullptr;
+		size_t nodeCount = 0;
+		const int* triangleIndices = nullptr;
+		size_t triangleIndexCount = 0;
+		const CompressedNode* compressedNodes = nullptr;
+		size_t compressedNodeCount = 0;
+		const uint16_t* packedTriangleIndices16 = nullptr;
+		const uint32_t* packedTriangleIndices32 = nullptr;
+		size_t packedTriangleIndexCount = 0;
+	};
+
+	// Shared, so copies of a mapped hierarchy stay valid
+	std::shared_ptr<CRTMappedFile> mapping;
+	View mappedView;
+
+	View getView() const;
+
+	struct BuildTriangle
+	{
+		float boundsMin[3];
+		float boundsMax[3];
+		float centroid[3];
+		int index;
+	};
+
+	int buildNode(std::vector<BuildTriangle>& triangles, int begin, int end, int depth);
+	void compress();
+	void compressNode(int nodeIdx, const float* boxMin, const float* boxMax);
+
+	static int getPackedTriangleIndex(const View& view, size_t i);
+
+	int intersectFloat(const CRTTriangleStream& stream, const CRTRay& ray, float maxT, float& closestT, bool anyHit,
+					   long long& boxTests, long long& triangleTests) const;
+	int intersectCompressed(const CRTTriangleStream& stream, const CRTRay& ray, float maxT, float& closestT,
+							bool anyHit, long long& boxTests, long long& triangleTests) const;
+};
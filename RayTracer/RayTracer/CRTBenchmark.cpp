@@ -0,0 +1,736 @@
+#include "CRTBenchmark.h"
+#include "CRTHeapTracker.h"
+#include "CRTCameraFrame.h"
+#include "CRTRandom.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// The parser and renderScene report progress on std::cout, which would drown the results
+class CoutSilencer
+{
+public:
+	CoutSilencer() : previous(std::cout.rdbuf(sink.rdbuf()))
+	{
+	}
+
+	~CoutSilencer()
+	{
+		std::cout.rdbuf(previous);
+	}
+
+private:
+	std::ostringstream sink;
+	std::streambuf* previous;
+};
+
+// Results of the measured work end up here so the optimiser cannot drop it
+static volatile long long benchmarkSink = 0;
+
+static double getMin(const std::vector<double>& samples)
+{
+	return *std::min_element(samples.begin(), samples.end());
+}
+
+static double getMedian(std::vector<double> samples)
+{
+	std::sort(samples.begin(), samples.end());
+	size_t mid = samples.size() / 2;
+
+	return samples.size() % 2 == 0 ? (samples[mid - 1] + samples[mid]) / 2.0 : samples[mid];
+}
+
+static double getMean(const std::vector<double>& samples)
+{
+	double sum = 0.0;
+	for (double sample : samples)
+	{
+		sum += sample;
+	}
+
+	return sum / samples.size();
+}
+
+CRTBenchmark::CRTBenchmark(const CRTBenchmarkSettings& settings) : settings(settings)
+{
+	this->settings.warmup = std::max(0, settings.warmup);
+	this->settings.repeat = std::max(1, settings.repeat);
+}
+
+template <typename Func>
+CRTBenchmarkResult CRTBenchmark::measure(const std::string& name, const std::string& unit, Func func) const
+{
+	CRTBenchmarkResult result;
+	result.name = name;
+	result.unit = unit;
+
+	for (int i = 0; i < settings.warmup; i++)
+	{
+		func();
+	}
+
+	for (int i = 0; i < settings.repeat; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		result.items = func();
+		auto end = std::chrono::steady_clock::now();
+
+		result.samples.push_back(std::chrono::duration<double>(end - start).count());
+	}
+
+	return result;
+}
+
+bool CRTBenchmark::run()
+{
+	bool kernelsAgree = true;
+	const bool bvhAgrees = verifyBVH();
+
+	std::vector<std::string> scenePaths;
+
+	for (const auto& entry : std::filesystem::directory_iterator(settings.scenesDirectory))
+	{
+		const std::string fileName = entry.path().filename().string();
+
+		if (entry.path().extension() != ".crtscene")
+			continue;
+
+		if (!settings.sceneFilter.empty() && fileName.find(settings.sceneFilter) == std::string::npos)
+			continue;
+
+		scenePaths.push_back(entry.path().string());
+	}
+
+	std::sort(scenePaths.begin(), scenePaths.end());
+
+	std::ofstream ofs(settings.outputFile);
+	rapidjson::OStreamWrapper osw(ofs);
+	rapidjson::PrettyWriter<rapidjson::OStreamWrapper> writer(osw);
+
+	writer.StartObject();
+	writer.Key("kernel");
+	writer.String(CRTTriangleKernels::getName(CRTTriangleKernels::getBestSupported()));
+	writer.Key("warmup");
+	writer.Int(settings.warmup);
+	writer.Key("repeat");
+	writer.Int(settings.repeat);
+	writer.Key("resolution_scale");
+	writer.Double(settings.resolutionScale);
+
+	writer.Key("scenes");
+	writer.StartArray();
+
+	for (const std::string& scenePath : scenePaths)
+	{
+		std::cout << scenePath << std::endl;
+
+		std::vector<CRTBenchmarkResult> results = runScene(scenePath, kernelsAgree);
+
+		writer.StartObject();
+		writer.Key("scene");
+		writer.String(std::filesystem::path(scenePath).filename().string().c_str());
+		writer.Key("results");
+		writer.StartArray();
+		for (const CRTBenchmarkResult& result : results)
+		{
+			printResult(result);
+			writeResult(writer, result);
+		}
+		writer.EndArray();
+		writer.EndObject();
+	}
+
+	writer.EndArray();
+	writer.EndObject();
+
+	ofs << std::endl;
+	std::cout << "Results written to " << settings.outputFile << std::endl;
+
+	if (!kernelsAgree)
+	{
+		std::cerr << "FAILED: the SIMD triangle kernels disagree with the scalar kernel, see above" << std::endl;
+	}
+
+	if (!bvhAgrees)
+	{
+		std::cerr << "FAILED: the BVH disagrees with the scalar kernel, see above" << std::endl;
+	}
+
+	return kernelsAgree && bvhAgrees;
+}
+
+std::vector<CRTBenchmarkResult> CRTBenchmark::runScene(const std::string& scenePath, bool& kernelsAgree) const
+{
+	std::vector<CRTBenchmarkResult> results;
+
+	results.push_back(measureLoad(scenePath));
+
+	CoutSilencer silencer;
+	CRTScene scene(scenePath);
+
+	CRTSettings sceneSettings = scene.getSettings();
+	sceneSettings.imageWidth = std::max(1, static_cast<int>(sceneSettings.imageWidth * settings.resolutionScale));
+	sceneSettings.imageHeight = std::max(1, static_cast<int>(sceneSettings.imageHeight * settings.resolutionScale));
+	scene.setSettings(sceneSettings);
+
+	Renderer renderer(&scene);
+
+	results.push_back(measureRayGeneration("ray_generation", renderer, scene, false));
+	results.push_back(measureRayGeneration("ray_generation_rows", renderer, scene, true));
+	results.push_back(measureLensRayGeneration(renderer, scene));
+	results.push_back(measurePrimaryRays(renderer, scene));
+
+	// Shadow and secondary rays start from the primary hits, gathered once outside the timed loops
+	std::vector<CRTRay> primaryRays;
+	std::vector<CRTRay> shadowRays;
+	std::vector<float> shadowMaxTs;
+	std::vector<CRTRay> secondaryRays;
+
+	for (int j = 0; j < sceneSettings.imageHeight; j++)
+	{
+		for (int i = 0; i < sceneSettings.imageWidth; i++)
+		{
+			CRTRay ray = renderer.genRay(i, j, scene.getCamera(), sceneSettings.imageWidth, sceneSettings.imageHeight);
+			primaryRays.push_back(ray);
+
+			RayIntersectionData data = renderer.traceRay(ray);
+			if (!data.isIntersected)
+				continue;
+
+			for (const CRTLight& light : scene.getLights())
+			{
+				CRTVector lightDir = light.getPosition() - data.intersectionPoint;
+				float maxT = lightDir.length() - 1e-2f;
+				lightDir.normalise();
+
+				shadowRays.push_back(CRTRay(data.intersectionPoint + data.intersectionTriangle.getNormal() * 1e-2f,
+											lightDir, 1, CRTRayType::SHADOW));
+				shadowMaxTs.push_back(maxT);
+			}
+
+			const CRTVector& normal = data.intersectionPointNormal;
+			CRTVector reflectionDir = ray.getDirection() - 2 * dot(ray.getDirection(), normal) * normal;
+
+			secondaryRays.push_back(CRTRay(data.intersectionPoint + normal * 1e-2f, reflectionDir, 1, CRTRayType::REFLECTION));
+		}
+	}
+
+	std::vector<float> secondaryMaxTs(secondaryRays.size(), std::numeric_limits<float>::infinity());
+
+	results.push_back(measureRays("shadow_rays", renderer, shadowRays, shadowMaxTs));
+	results.push_back(measureRays("secondary_rays", renderer, secondaryRays, secondaryMaxTs));
+
+	std::vector<float> primaryMaxTs(primaryRays.size(), std::numeric_limits<float>::infinity());
+
+	for (CRTKernelType kernelType : { CRTKernelType::SCALAR, CRTKernelType::SSE, CRTKernelType::AVX2 })
+	{
+		if (CRTTriangleKernels::isSupported(kernelType))
+		{
+			if (kernelType != CRTKernelType::SCALAR)
+			{
+				const bool agrees = verifyKernel(kernelType, scene, primaryRays, primaryMaxTs) &&
+									verifyKernel(kernelType, scene, shadowRays, shadowMaxTs) &&
+									verifyKernel(kernelType, scene, secondaryRays, secondaryMaxTs);
+				kernelsAgree = kernelsAgree && agrees;
+			}
+
+			results.push_back(measureTriangleTests(kernelType, scene, primaryRays));
+		}
+	}
+
+	if (!scene.getTextures().empty())
+	{
+		results.push_back(measureTextureSamples(scene));
+	}
+
+	results.push_back(measureRender("render", renderer));
+	results.back().dataBytes = scene.getMeshBytes();
+
+	Renderer batchingRenderer(&scene);
+	batchingRenderer.setShadowBatchingEnabled(true);
+	results.push_back(measureRender("render_shadow_batch", batchingRenderer));
+
+	// Last, the scene keeps its compact meshes
+	scene.compactMeshes(false);
+	results.push_back(measureRender("render_compact_meshes", renderer));
+	results.back().dataBytes = scene.getMeshBytes();
+
+	// The BVH layouts are compared on a scene of their own, with uncompressed meshes
+	CRTScene bvhScene(scenePath);
+	bvhScene.setSettings(sceneSettings);
+	Renderer bvhRenderer(&bvhScene);
+
+	for (CRTBVHLayout layout : { CRTBVHLayout::FLOAT, CRTBVHLayout::COMPRESSED })
+	{
+		const std::string suffix = layout == CRTBVHLayout::FLOAT ? "_bvh_float" : "_bvh_compressed";
+
+		results.push_back(measureBVHBuild("build" + suffix, layout, bvhScene));
+		results.push_back(measureBVHCacheLoad("cache_load" + suffix, layout, bvhScene));
+		bvhScene.buildBVHs(layout);
+
+		results.push_back(measureRays("primary_rays" + suffix, bvhRenderer, primaryRays, primaryMaxTs));
+		results.push_back(measureRays("shadow_rays" + suffix, bvhRenderer, shadowRays, shadowMaxTs));
+		results.push_back(measureRays("secondary_rays" + suffix, bvhRenderer, secondaryRays, secondaryMaxTs));
+		results.push_back(measureRender("render" + suffix, bvhRenderer));
+	}
+
+	return results;
+}
+
+CRTBenchmarkResult CRTBenchmark::measureLoad(const std::string& scenePath) const
+{
+	CoutSilencer silencer;
+
+	CRTBenchmarkResult result = measure("scene_load", "scene", [&]() {
+		CRTScene scene(scenePath);
+		return 1LL;
+	});
+
+	// One more load outside the timed repetitions, counting its heap use
+	if (CRTHeapTracker::isEnabled())
+	{
+		const long long allocationsBefore = CRTHeapTracker::getThreadAllocations();
+		const long long bytesBefore = CRTHeapTracker::getBytesInUse();
+		CRTHeapTracker::resetPeakBytes();
+
+		{
+			CRTScene scene(scenePath);
+		}
+
+		result.heapAllocations = CRTHeapTracker::getThreadAllocations() - allocationsBefore;
+		result.peakHeapBytes = CRTHeapTracker::getPeakBytes() - bytesBefore;
+	}
+
+	return result;
+}
+
+CRTBenchmarkResult CRTBenchmark::measureRayGeneration(const std::string& name, const Renderer& renderer,
+													  const CRTScene& scene, bool rows) const
+{
+	const int width = scene.getSettings().imageWidth;
+	const int height = scene.getSettings().imageHeight;
+
+	std::vector<float> sampleX(width, 0.5f);
+	std::vector<float> sampleY(width, 0.5f);
+	std::vector<float> dirX(width);
+	std::vector<float> dirY(width);
+	std::vector<float> dirZ(width);
+
+	return measure(name, "ray", [&]() {
+		float sum = 0.f;
+
+		for (int j = 0; j < height; j++)
+		{
+			if (rows)
+			{
+				CRTCameraFrame frame(scene.getCamera(), width, height);
+				frame.getRowDirections(j, 0, width, sampleX.data(), sampleY.data(), dirX.data(), dirY.data(), dirZ.data());
+				for (int i = 0; i < width; i++)
+				{
+					sum += dirX[i] + dirY[i] + dirZ[i];
+				}
+			}
+			else
+			{
+				for (int i = 0; i < width; i++)
+				{
+					const CRTVector& direction = renderer.genRay(i, j, scene.getCamera(), width, height).getDirection();
+					sum += direction.getX() + direction.getY() + direction.getZ();
+				}
+			}
+		}
+
+		benchmarkSink = benchmarkSink + static_cast<long long>(sum);
+		return static_cast<long long>(width) * height;
+	});
+}
+
+CRTBenchmarkResult CRTBenchmark::measureLensRayGeneration(const Renderer& renderer, const CRTScene& scene) const
+{
+	const int width = scene.getSettings().imageWidth;
+	const int height = scene.getSettings().imageHeight;
+
+	CRTCamera camera = scene.getCamera();
+	camera.setLens(0.1f, 5.f);
+	camera.openShutter();
+	camera.pan(2.f);
+	camera.closeShutter();
+	const CRTCameraFrame frame(camera, width, height);
+	const std::vector<CRTCameraFrame> shutterFrames = renderer.getShutterFrames(camera);
+
+	return measure("ray_generation_lens", "ray", [&]() {
+		float sum = 0.f;
+
+		for (int j = 0; j < height; j++)
+		{
+			for (int i = 0; i < width; i++)
+			{
+				CRTSampler sampler(renderer.getSamplerType(), i, j);
+				sampler.startSample(1);
+				float sampleX, sampleY;
+				sampler.get2D(sampleX, sampleY);
+				CRTCameraSample cameraSample;
+				cameraSample.draw(sampler);
+
+				const CRTVector& direction = renderer.genLensRay(i + sampleX, j + sampleY, cameraSample, frame, &shutterFrames).getDirection();
+				sum += direction.getX() + direction.getY() + direction.getZ();
+			}
+		}
+
+		benchmarkSink = benchmarkSink + static_cast<long long>(sum);
+		return static_cast<long long>(width) * height;
+	});
+}
+
+CRTBenchmarkResult CRTBenchmark::measurePrimaryRays(const Renderer& renderer, const CRTScene& scene) const
+{
+	const int width = scene.getSettings().imageWidth;
+	const int height = scene.getSettings().imageHeight;
+
+	return measure("primary_rays", "ray", [&]() {
+		long long hits = 0;
+
+		for (int j = 0; j < height; j++)
+		{
+			for (int i = 0; i < width; i++)
+			{
+				CRTRay ray = renderer.genRay(i, j, scene.getCamera(), width, height);
+				hits += renderer.traceRay(ray).isIntersected ? 1 : 0;
+			}
+		}
+
+		benchmarkSink = benchmarkSink + hits;
+		return static_cast<long long>(width) * height;
+	});
+}
+
+CRTBenchmarkResult CRTBenchmark::measureRays(const std::string& name, const Renderer& renderer,
+											 const std::vector<CRTRay>& rays, const std::vector<float>& maxTs) const
+{
+	return measure(name, "ray", [&]() {
+		long long hits = 0;
+
+		for (size_t i = 0; i < rays.size(); i++)
+		{
+			hits += renderer.traceRay(rays[i], maxTs[i]).isIntersected ? 1 : 0;
+		}
+
+		benchmarkSink = benchmarkSink + hits;
+		return static_cast<long long>(rays.size());
+	});
+}
+
+bool CRTBenchmark::verifyKernel(CRTKernelType kernelType, const CRTScene& scene, const std::vector<CRTRay>& rays,
+							   const std::vector<float>& maxTs) const
+{
+	CRTTriangleKernels::Kernel kernel = CRTTriangleKernels::getKernel(kernelType);
+	const int maxReported = 10;
+	long long mismatches = 0;
+
+	for (size_t i = 0; i < rays.size(); i++)
+	{
+		for (const CRTMesh& mesh : scene.getObjects())
+		{
+			float scalarT = maxTs[i];
+			float kernelT = maxTs[i];
+			const int scalarHit = CRTTriangleKernels::intersectScalar(mesh.getTriangleStream(), rays[i], maxTs[i], scalarT);
+			const int kernelHit = kernel(mesh.getTriangleStream(), rays[i], maxTs[i], kernelT);
+
+			// A different triangle at the same distance is a tie on a shared edge, which either may take
+			const bool agree = (scalarHit < 0) == (kernelHit < 0) &&
+							   (scalarHit < 0 || std::fabs(scalarT - kernelT) <= 1e-4f * std::max(1.f, scalarT));
+			if (agree)
+				continue;
+
+			if (mismatches++ < maxReported)
+			{
+				std::cerr << CRTTriangleKernels::getName(kernelType) << " kernel disagrees with scalar on ray " << i
+						  << ": triangle " << kernelHit << " at t " << kernelT << ", scalar triangle " << scalarHit
+						  << " at t " << scalarT << std::endl;
+			}
+		}
+	}
+
+	if (mismatches > maxReported)
+	{
+		std::cerr << "... " << mismatches << " mismatches in total" << std::endl;
+	}
+
+	return mismatches == 0;
+}
+
+bool CRTBenchmark::verifyBVH() const
+{
+	const int degenerateCount = 5000;
+	const int triangleCount = 70000;
+	const int gridWidth = 260;
+
+	std::vector<CRTVector> vertices;
+	std::vector<int> indices;
+	for (int i = 0; i < triangleCount; i++)
+	{
+		const int k = i - degenerateCount;
+		const float x = static_cast<float>(k % gridWidth);
+		const float y = static_cast<float>(k / gridWidth);
+		const float z = 0.1f * (k % 7);
+		const float size = i < degenerateCount ? 0.f : 0.9f;
+
+		vertices.push_back(CRTVector(x, y, z));
+		vertices.push_back(CRTVector(x + size, y, z));
+		vertices.push_back(CRTVector(x, y + size, z));
+		for (int corner = 0; corner < 3; corner++)
+		{
+			indices.push_back(i * 3 + corner);
+		}
+	}
+
+	CRTTriangleStream stream;
+	stream.build(vertices, indices);
+
+	std::vector<CRTRay> rays;
+	CRTRandom random(1);
+	const float gridHeight = static_cast<float>((triangleCount - degenerateCount) / gridWidth);
+	for (int i = 0; i < 500; i++)
+	{
+		const CRTVector origin(random.nextFloat() * gridWidth, random.nextFloat() * gridHeight, 10.f);
+		rays.push_back(CRTRay(origin, CRTVector(0.f, 0.f, -1.f), 0, CRTRayType::CAMERA));
+	}
+
+	const int maxReported = 10;
+	long long mismatches = 0;
+
+	for (CRTBVHLayout layout : { CRTBVHLayout::FLOAT, CRTBVHLayout::COMPRESSED })
+	{
+		CRTBVH bvh;
+		bvh.build(stream, layout);
+
+		for (size_t i = 0; i < rays.size(); i++)
+		{
+			const float maxT = std::numeric_limits<float>::infinity();
+			float scalarT = maxT;
+			float bvhT = maxT;
+			long long boxTests = 0;
+			long long triangleTests = 0;
+			const int scalarHit = CRTTriangleKernels::intersectScalar(stream, rays[i], maxT, scalarT);
+			const int bvhHit = bvh.intersect(stream, rays[i], maxT, bvhT, false, boxTests, triangleTests);
+
+			if (scalarHit == bvhHit && (scalarHit < 0 || scalarT == bvhT))
+				continue;
+
+			if (mismatches++ < maxReported)
+			{
+				std::cerr << (layout == CRTBVHLayout::COMPRESSED ? "compressed" : "float") << " BVH disagrees with scalar on ray " << i << ": triangle "
+						  << bvhHit << " at t " << bvhT << ", scalar triangle " << scalarHit << " at t " << scalarT
+						  << std::endl;
+			}
+		}
+	}
+
+	if (mismatches > maxReported)
+	{
+		std::cerr << "... " << mismatches << " mismatches in total" << std::endl;
+	}
+
+	return mismatches == 0;
+}
+
+CRTBenchmarkResult CRTBenchmark::measureTriangleTests(CRTKernelType kernelType, const CRTScene& scene,
+													  const std::vector<CRTRay>& rays) const
+{
+	CRTTriangleKernels::Kernel kernel = CRTTriangleKernels::getKernel(kernelType);
+
+	long long trianglesPerRay = 0;
+	for (const CRTMesh& mesh : scene.getObjects())
+	{
+		trianglesPerRay += mesh.getTriangleStream().getTriangleCount();
+	}
+
+	return measure(std::string("triangle_tests_") + CRTTriangleKernels::getName(kernelType), "triangle_test", [&]() {
+		long long hits = 0;
+
+		for (const CRTRay& ray : rays)
+		{
+			for (const CRTMesh& mesh : scene.getObjects())
+			{
+				float closestT = std::numeric_limits<float>::infinity();
+				hits += kernel(mesh.getTriangleStream(), ray, closestT, closestT) >= 0 ? 1 : 0;
+			}
+		}
+
+		benchmarkSink = benchmarkSink + hits;
+		return static_cast<long long>(rays.size()) * trianglesPerRay;
+	});
+}
+
+CRTBenchmarkResult CRTBenchmark::measureTextureSamples(const CRTScene& scene) const
+{
+	const int gridSize = 512;
+
+	return measure("texture_samples", "sample", [&]() {
+		float sum = 0.f;
+
+		for (const CRTTexture* texture : scene.getTextures())
+		{
+			for (int j = 0; j < gridSize; j++)
+			{
+				for (int i = 0; i < gridSize; i++)
+				{
+					sum += texture->getColor((i + 0.5f) / gridSize, (j + 0.5f) / gridSize).getX();
+				}
+			}
+		}
+
+		benchmarkSink = benchmarkSink + static_cast<long long>(sum);
+		return static_cast<long long>(scene.getTextures().size()) * gridSize * gridSize;
+	});
+}
+
+CRTBenchmarkResult CRTBenchmark::measureRender(const std::string& name, const Renderer& renderer) const
+{
+	const std::string outputFile = "benchmark_render.ppm";
+
+	CRTBenchmarkResult result = measure(name, "frame", [&]() {
+		renderer.renderScene(outputFile);
+		return 1LL;
+	});
+
+	std::remove(outputFile.c_str());
+
+	return result;
+}
+
+CRTBenchmarkResult CRTBenchmark::measureBVHBuild(const std::string& name, CRTBVHLayout layout, const CRTScene& scene) const
+{
+	size_t bytes = 0;
+
+	CRTBenchmarkResult result = measure(name, "triangle", [&]() {
+		long long triangles = 0;
+		bytes = 0;
+
+		for (const CRTMesh& mesh : scene.getObjects())
+		{
+			const CRTTriangleStream& stream = mesh.getTriangleStream();
+			if (stream.getTriangleCount() < CRTBVH::MIN_TRIANGLES)
+				continue;
+
+			CRTBVH bvh;
+			bvh.build(stream, layout);
+			bytes += bvh.getMemoryBytes();
+			triangles += stream.getTriangleCount();
+		}
+
+		return triangles;
+	});
+
+	result.dataBytes = bytes;
+	return result;
+}
+
+CRTBenchmarkResult CRTBenchmark::measureBVHCacheLoad(const std::string& name, CRTBVHLayout layout,
+													 const CRTScene& scene) const
+{
+	const std::filesystem::path cacheDirectory = std::filesystem::temp_directory_path() / "crt_bvh_benchmark";
+	std::filesystem::create_directories(cacheDirectory);
+
+	// The files are written once, the repetitions time hashing the meshes and mapping the files
+	std::vector<std::string> cacheFiles;
+	std::vector<uint64_t> keys;
+	std::vector<uint64_t> checksums;
+	for (const CRTMesh& mesh : scene.getObjects())
+	{
+		const CRTTriangleStream& stream = mesh.getTriangleStream();
+		if (stream.getTriangleCount() < CRTBVH::MIN_TRIANGLES)
+			continue;
+
+		CRTBVH bvh;
+		bvh.build(stream, layout);
+		keys.push_back(CRTBVH::getCacheKey(stream, layout));
+		checksums.push_back(CRTBVH::getCacheChecksum(stream));
+		cacheFiles.push_back((cacheDirectory / (std::to_string(keys.size()) + ".bvh")).string());
+		bvh.saveCache(cacheFiles.back(), keys.back(), checksums.back());
+	}
+
+	CRTBenchmarkResult result = measure(name, "triangle", [&]() {
+		long long triangles = 0;
+		size_t fileIdx = 0;
+
+		for (const CRTMesh& mesh : scene.getObjects())
+		{
+			const CRTTriangleStream& stream = mesh.getTriangleStream();
+			if (stream.getTriangleCount() < CRTBVH::MIN_TRIANGLES)
+				continue;
+
+			CRTBVH bvh;
+			if (CRTBVH::getCacheKey(stream, layout) == keys[fileIdx] &&
+				bvh.loadCache(cacheFiles[fileIdx], keys[fileIdx], CRTBVH::getCacheChecksum(stream)))
+				triangles += stream.getTriangleCount();
+			fileIdx++;
+		}
+
+		return triangles;
+	});
+
+	std::error_code error;
+	std::filesystem::remove_all(cacheDirectory, error);
+	return result;
+}
+
+void CRTBenchmark::printResult(const CRTBenchmarkResult& result) const
+{
+	const double median = getMedian(result.samples);
+
+	std::cout << "  " << result.name << ": " << median * 1000.0 << " ms";
+	if (result.items > 1)
+	{
+		std::cout << ", " << result.items / median / 1e6 << " M " << result.unit << "/s";
+	}
+	if (result.heapAllocations >= 0)
+	{
+		std::cout << ", " << result.heapAllocations << " allocations, "
+				  << result.peakHeapBytes / (1024.0 * 1024.0) << " MB peak";
+	}
+	if (result.dataBytes >= 0)
+	{
+		std::cout << ", " << result.dataBytes / (1024.0 * 1024.0) << " MB data";
+	}
+	std::cout << std::endl;
+}
+
+void CRTBenchmark::writeResult(rapidjson::PrettyWriter<rapidjson::OStreamWrapper>& writer, const CRTBenchmarkResult& result) const
+{
+	const double median = getMedian(result.samples);
+
+	writer.StartObject();
+	writer.Key("name");
+	writer.String(result.name.c_str());
+	writer.Key("unit");
+	writer.String(result.unit.c_str());
+	writer.Key("items");
+	writer.Int64(result.items);
+	writer.Key("min_seconds");
+	writer.Double(getMin(result.samples));
+	writer.Key("median_seconds");
+	writer.Double(median);
+	writer.Key("mean_seconds");
+	writer.Double(getMean(result.samples));
+	writer.Key("items_per_second");
+	writer.Double(median > 0.0 ? result.items / median : 0.0);
+	if (result.heapAllocations >= 0)
+	{
+		writer.Key("heap_allocations");
+		writer.Int64(result.heapAllocations);
+		writer.Key("peak_heap_bytes");
+		writer.Int64(result.peakHeapBytes);
+	}
+	if (result.dataBytes >= 0)
+	{
+		writer.Key("data_bytes");
+		writer.Int64(result.dataBytes);
+	}
+	writer.EndObject();
+}
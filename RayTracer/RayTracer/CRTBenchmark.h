@@ -0,0 +1,78 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "CRTScene.h"
+#include "Renderer.h"
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/ostreamwrapper.h"
+
+struct CRTBenchmarkSettings
+{
+	std::string scenesDirectory = "Scenes";
+	std::string sceneFilter; //Only scenes whose file name contains this
+	std::string outputFile = "benchmark.json";
+	int warmup = 1;
+	int repeat = 5;
+	float resolutionScale = 0.25f; //Applied to the image size from each scene file
+};
+
+// Timings of one measured operation, each sample is one repetition in seconds
+struct CRTBenchmarkResult
+{
+	std::string name;
+	std::string unit; //What one item is: "ray", "triangle_test", ...
+	long long items = 0; //Items processed by one repetition
+	std::vector<double> samples;
+	// Heap allocations and peak heap growth of one repetition, -1 when not tracked (see CRTHeapTracker)
+	long long heapAllocations = -1;
+	long long peakHeapBytes = -1;
+	// Size of the scene data the operation reads, e.g. the mesh data for renders, -1 when not reported
+	long long dataBytes = -1;
+};
+
+// Loads every .crtscene file of a directory and measures load time, ray and
+// triangle-test throughput, texture sampling and end-to-end rendering.
+// The results are printed and written as JSON. Before the triangle tests are timed, every SIMD kernel
+// is checked against the scalar one on the same rays.
+class CRTBenchmark
+{
+public:
+	CRTBenchmark(const CRTBenchmarkSettings& settings);
+
+	// False when a kernel or BVH layout disagreed with the scalar kernel
+	bool run();
+
+private:
+	CRTBenchmarkSettings settings;
+
+	template <typename Func>
+	CRTBenchmarkResult measure(const std::string& name, const std::string& unit, Func func) const;
+
+	std::vector<CRTBenchmarkResult> runScene(const std::string& scenePath, bool& kernelsAgree) const;
+
+	CRTBenchmarkResult measureLoad(const std::string& scenePath) const;
+	CRTBenchmarkResult measurePrimaryRays(const Renderer& renderer, const CRTScene& scene) const;
+	// Camera rays only, one genRay() per pixel or whole rows from a CRTCameraFrame
+	CRTBenchmarkResult measureRayGeneration(const std::string& name, const Renderer& renderer, const CRTScene& scene,
+											bool rows) const;
+	// Camera rays through a thin lens from a panning camera, with the sampler draws of progressive sample 1
+	CRTBenchmarkResult measureLensRayGeneration(const Renderer& renderer, const CRTScene& scene) const;
+	CRTBenchmarkResult measureRays(const std::string& name, const Renderer& renderer, const std::vector<CRTRay>& rays,
+								   const std::vector<float>& maxTs) const;
+	CRTBenchmarkResult measureTriangleTests(CRTKernelType kernelType, const CRTScene& scene,
+											const std::vector<CRTRay>& rays) const;
+	// Runs the kernel and intersectScalar on every ray and mesh and reports on std::cerr the rays where
+	// they disagree on the hit, or on its distance beyond rounding. Returns whether they all agreed.
+	bool verifyKernel(CRTKernelType kernelType, const CRTScene& scene, const std::vector<CRTRay>& rays,
+					  const std::vector<float>& maxTs) const;
+	// Compares both BVH layouts with intersectScalar on a generated mesh of more than 65536 triangles,
+	// the first of them degenerate, so that the BVH has fewer entries than the largest stream index.
+	bool verifyBVH() const;
+	CRTBenchmarkResult measureTextureSamples(const CRTScene& scene) const;
+	CRTBenchmarkResult measureRender(const std::string& name, const Renderer& renderer) const;
+	CRTBenchmarkResult measureBVHBuild(const std::string& name, CRTBVHLayout layout, const CRTScene& scene) const;
+	CRTBenchmarkResult measureBVHCacheLoad(const std::string& name, CRTBVHLayout layout, const CRTScene& scene) const;
+
+	void printResult(const CRTBenchmarkResult& result) const;
+	void writeResult(rapidjson::PrettyWriter<rapidjson::OStreamWrapper>& writer, const CRTBenchmarkResult& result) const;
+};
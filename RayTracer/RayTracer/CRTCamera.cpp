@@ -4,59 +4,78 @@
 #include <cmath>
 #include "CRTLight.h"
 
-void CRTCamera::pan(const float degrees)
+static CRTMatrix rotationAroundX(const float degrees)
 {
 	const float rads = degrees * (M_PI / 180.f);
-	const CRTMatrix rotateAroundY(
-		cosf(rads), 0.f, -sinf(rads),
-		0.f,        1.f, 0.f,
-		sinf(rads), 0.f, cosf(rads)
+	return CRTMatrix(
+		1.f, 0.f,		 0.f,
+		0.f, cosf(rads), -sinf(rads),
+		0.f, sinf(rads), cosf(rads)
 	);
-
-	rotationMatrix = rotationMatrix * rotateAroundY;
 }
 
-void CRTCamera::tilt(const float degrees)
+static CRTMatrix rotationAroundY(const float degrees)
 {
 	const float rads = degrees * (M_PI / 180.f);
-	const CRTMatrix rotateAroundX(
-		1.f, 0.f,		 0.f,
-		0.f, cosf(rads), -sinf(rads),
-		0.f, sinf(rads), cosf(rads)
+	return CRTMatrix(
+		cosf(rads), 0.f, -sinf(rads),
+		0.f,        1.f, 0.f,
+		sinf(rads), 0.f, cosf(rads)
 	);
-
-	rotationMatrix = rotationMatrix * rotateAroundX;
 }
 
-void CRTCamera::roll(const float degrees)
+static CRTMatrix rotationAroundZ(const float degrees)
 {
 	const float rads = degrees * (M_PI / 180.f);
-	const CRTMatrix rotateAroundZ(
+	return CRTMatrix(
 		cosf(rads), -sinf(rads), 0.f,
 		sinf(rads),  cosf(rads), 0.f,
 		0.f,		 0.f,	     1.f
 	);
-
-	rotationMatrix = rotationMatrix * rotateAroundZ;
 }
 
-void CRTCamera::panAroundTarget(const float degrees, const CRTVector& target)
+static void orbit(const float degrees, const CRTVector& target, CRTMatrix& rotation, CRTVector& position)
 {
+	const CRTMatrix rotateAroundY = rotationAroundY(degrees);
 
 	CRTVector toCamera = position - target;
-
-	const float rads = degrees * (M_PI / 180.f);
-	const CRTMatrix rotateAroundY(
-		cosf(rads), 0.f, -sinf(rads),
-		0.f, 1.f, 0.f,
-		sinf(rads), 0.f, cosf(rads)
-	);
-
 	CRTVector rotated = toCamera * rotateAroundY;
 
 	position = target + rotated;
 
-	rotationMatrix = rotationMatrix * rotateAroundY;
+	rotation = rotation * rotateAroundY;
+}
+
+void CRTCamera::pan(const float degrees)
+{
+	if (shutterOpen)
+		shutterMotion.push_back({ Motion::PAN, degrees, CRTVector() });
+
+	rotationMatrix = rotationMatrix * rotationAroundY(degrees);
+}
+
+void CRTCamera::tilt(const float degrees)
+{
+	if (shutterOpen)
+		shutterMotion.push_back({ Motion::TILT, degrees, CRTVector() });
+
+	rotationMatrix = rotationMatrix * rotationAroundX(degrees);
+}
+
+void CRTCamera::roll(const float degrees)
+{
+	if (shutterOpen)
+		shutterMotion.push_back({ Motion::ROLL, degrees, CRTVector() });
+
+	rotationMatrix = rotationMatrix * rotationAroundZ(degrees);
+}
+
+void CRTCamera::panAroundTarget(const float degrees, const CRTVector& target)
+{
+	if (shutterOpen)
+		shutterMotion.push_back({ Motion::PAN_AROUND_TARGET, degrees, target });
+
+	orbit(degrees, target, rotationMatrix, position);
 }
 
 const CRTVector& CRTCamera::getPosition() const
@@ -78,3 +97,70 @@ void CRTCamera::setPosition(const CRTVector& position)
 {
 	this->position = position;
 }
+
+void CRTCamera::setLens(float apertureRadius, float focusDistance)
+{
+	this->apertureRadius = apertureRadius;
+	this->focusDistance = focusDistance;
+}
+
+float CRTCamera::getApertureRadius() const
+{
+	return apertureRadius;
+}
+
+float CRTCamera::getFocusDistance() const
+{
+	return focusDistance;
+}
+
+void CRTCamera::openShutter()
+{
+	shutterOpen = true;
+	shutterOpenRotation = rotationMatrix;
+	shutterOpenPosition = position;
+	shutterMotion.clear();
+}
+
+void CRTCamera::closeShutter()
+{
+	shutterOpen = false;
+}
+
+bool CRTCamera::isMoving() const
+{
+	return !shutterMotion.empty();
+}
+
+void CRTCamera::getPose(float time, CRTMatrix& rotation, CRTVector& position) const
+{
+	if (shutterMotion.empty())
+	{
+		rotation = rotationMatrix;
+		position = this->position;
+		return;
+	}
+
+	// Every motion is replayed over the whole interval, so orbits stay on their arc
+	rotation = shutterOpenRotation;
+	position = shutterOpenPosition;
+	for (const MotionStep& step : shutterMotion)
+	{
+		const float degrees = step.degrees * time;
+		switch (step.motion)
+		{
+		case Motion::PAN:
+			rotation = rotation * rotationAroundY(degrees);
+			break;
+		case Motion::TILT:
+			rotation = rotation * rotationAroundX(degrees);
+			break;
+		case Motion::ROLL:
+			rotation = rotation * rotationAroundZ(degrees);
+			break;
+		case Motion::PAN_AROUND_TARGET:
+			orbit(degrees, step.target, rotation, position);
+			break;
+		}
+	}
+}
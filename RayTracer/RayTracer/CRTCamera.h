@@ -1,4 +1,5 @@
 #pragma once
+#include <vector>
 #include "Math/CRTVector.h"
 #include "Math/CRTMatrix.h"
 
@@ -16,9 +17,46 @@ public:
 
 	void setRotationMatrix(const CRTMatrix& matrix);
 	void setPosition(const CRTVector& position);
+
+	// Thin lens of apertureRadius in world units, a pinhole when it is 0. Points focusDistance in
+	// front of the camera, along its view axis, are in focus.
+	void setLens(float apertureRadius, float focusDistance);
+	float getApertureRadius() const;
+	float getFocusDistance() const;
+
+	// pan, tilt, roll and panAroundTarget called between openShutter and closeShutter move the camera
+	// while the shutter is open. The position and rotation getters return the pose at shutter close,
+	// getPose the one at a time in [0, 1] of the shutter interval, with every motion replayed that far.
+	// setPosition and setRotationMatrix are not recorded, they move the camera at shutter close.
+	void openShutter();
+	void closeShutter();
+	bool isMoving() const;
+	void getPose(float time, CRTMatrix& rotation, CRTVector& position) const;
 private:
+	enum class Motion
+	{
+		PAN,
+		TILT,
+		ROLL,
+		PAN_AROUND_TARGET
+	};
+
+	struct MotionStep
+	{
+		Motion motion;
+		float degrees;
+		CRTVector target;
+	};
+
 	CRTMatrix rotationMatrix;
 
 	CRTVector position;
-};
 
+	float apertureRadius = 0.f;
+	float focusDistance = 1.f;
+
+	bool shutterOpen = false;
+	CRTMatrix shutterOpenRotation;
+	CRTVector shutterOpenPosition;
+	std::vector<MotionStep> shutterMotion;
+};
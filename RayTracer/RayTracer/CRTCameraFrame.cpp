@@ -0,0 +1,155 @@
+#include "CRTCameraFrame.h"
+#include <cmath>
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define CRT_SSE_ROWS 1
+#include <xmmintrin.h>
+#else
+#define CRT_SSE_ROWS 0
+#endif
+
+CRTCameraFrame::CRTCameraFrame(const CRTCamera& camera, int imageWidth, int imageHeight)
+	: apertureRadius(camera.getApertureRadius()), focusDistance(camera.getFocusDistance())
+{
+	init(camera.getRotationMatrix(), camera.getPosition(), imageWidth, imageHeight);
+}
+
+CRTCameraFrame::CRTCameraFrame(const CRTCamera& camera, int imageWidth, int imageHeight, float time)
+	: apertureRadius(camera.getApertureRadius()), focusDistance(camera.getFocusDistance())
+{
+	CRTMatrix rotation;
+	CRTVector position;
+	camera.getPose(time, rotation, position);
+	init(rotation, position, imageWidth, imageHeight);
+}
+
+void CRTCameraFrame::init(const CRTMatrix& rotation, const CRTVector& position, int imageWidth, int imageHeight)
+{
+	origin = position;
+
+	// Camera space x, y and -z in world space, the rows of the rotation matrix
+	const CRTVector right = CRTVector(1.f, 0.f, 0.f) * rotation;
+	const CRTVector up = CRTVector(0.f, 1.f, 0.f) * rotation;
+	const CRTVector back = CRTVector(0.f, 0.f, 1.f) * rotation;
+
+	// Image point (px, py) is at camera space x = (2 px / width - 1) * aspect, y = 1 - 2 py / height, z = -1
+	const float aspect = static_cast<float>(imageWidth) / imageHeight;
+	topLeft = right * -aspect + up - back;
+	stepX = right * (2.f * aspect / imageWidth);
+	stepY = up * (-2.f / imageHeight);
+
+	lensX = right * apertureRadius;
+	lensY = up * apertureRadius;
+}
+
+CRTCameraFrame CRTCameraFrame::interpolate(const CRTCameraFrame& from, const CRTCameraFrame& to, float weight)
+{
+	CRTCameraFrame frame = from;
+	frame.origin = from.origin + (to.origin - from.origin) * weight;
+	frame.topLeft = from.topLeft + (to.topLeft - from.topLeft) * weight;
+	frame.stepX = from.stepX + (to.stepX - from.stepX) * weight;
+	frame.stepY = from.stepY + (to.stepY - from.stepY) * weight;
+	frame.lensX = from.lensX + (to.lensX - from.lensX) * weight;
+	frame.lensY = from.lensY + (to.lensY - from.lensY) * weight;
+	return frame;
+}
+
+const CRTVector& CRTCameraFrame::getOrigin() const
+{
+	return origin;
+}
+
+bool CRTCameraFrame::hasLens() const
+{
+	return apertureRadius > 0.f;
+}
+
+CRTVector CRTCameraFrame::getDirection(float px, float py) const
+{
+	CRTVector direction = topLeft + stepX * px + stepY * py;
+	direction.normalise();
+	return direction;
+}
+
+void CRTCameraFrame::getRowDirections(int y, int x0, int x1, const float* sampleX, const float* sampleY,
+									  float* dirX, float* dirY, float* dirZ) const
+{
+	const int count = x1 - x0;
+	int i = 0;
+
+#if CRT_SSE_ROWS
+	const __m128 topLeftX = _mm_set1_ps(topLeft.getX());
+	const __m128 topLeftY = _mm_set1_ps(topLeft.getY());
+	const __m128 topLeftZ = _mm_set1_ps(topLeft.getZ());
+	const __m128 stepXX = _mm_set1_ps(stepX.getX());
+	const __m128 stepXY = _mm_set1_ps(stepX.getY());
+	const __m128 stepXZ = _mm_set1_ps(stepX.getZ());
+	const __m128 stepYX = _mm_set1_ps(stepY.getX());
+	const __m128 stepYY = _mm_set1_ps(stepY.getY());
+	const __m128 stepYZ = _mm_set1_ps(stepY.getZ());
+	const __m128 rowY = _mm_set1_ps(static_cast<float>(y));
+	const __m128 laneStep = _mm_set1_ps(4.f);
+	__m128 pixelX = _mm_set_ps(x0 + 3.f, x0 + 2.f, x0 + 1.f, static_cast<float>(x0));
+
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 px = _mm_add_ps(pixelX, _mm_loadu_ps(sampleX + i));
+		const __m128 py = _mm_add_ps(rowY, _mm_loadu_ps(sampleY + i));
+
+		const __m128 dx = _mm_add_ps(_mm_add_ps(topLeftX, _mm_mul_ps(stepXX, px)), _mm_mul_ps(stepYX, py));
+		const __m128 dy = _mm_add_ps(_mm_add_ps(topLeftY, _mm_mul_ps(stepXY, px)), _mm_mul_ps(stepYY, py));
+		const __m128 dz = _mm_add_ps(_mm_add_ps(topLeftZ, _mm_mul_ps(stepXZ, px)), _mm_mul_ps(stepYZ, py));
+
+		// A full-precision square root and division, like CRTVector::normalise
+		const __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+													 _mm_mul_ps(dz, dz)));
+		_mm_storeu_ps(dirX + i, _mm_div_ps(dx, length));
+		_mm_storeu_ps(dirY + i, _mm_div_ps(dy, length));
+		_mm_storeu_ps(dirZ + i, _mm_div_ps(dz, length));
+
+		pixelX = _mm_add_ps(pixelX, laneStep);
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		const CRTVector direction = getDirection(x0 + i + sampleX[i], y + sampleY[i]);
+		dirX[i] = direction.getX();
+		dirY[i] = direction.getY();
+		dirZ[i] = direction.getZ();
+	}
+}
+
+void CRTCameraFrame::getLensRay(float px, float py, float lensU, float lensV,
+								CRTVector& rayOrigin, CRTVector& rayDirection) const
+{
+	// Concentric mapping of the square to the unit disk (Shirley and Chiu)
+	const float a = 2.f * lensU - 1.f;
+	const float b = 2.f * lensV - 1.f;
+	float diskX = 0.f;
+	float diskY = 0.f;
+	if (a != 0.f || b != 0.f)
+	{
+		const float quarterPi = 0.785398163f;
+		float radius;
+		float angle;
+		if (std::fabs(a) > std::fabs(b))
+		{
+			radius = a;
+			angle = quarterPi * (b / a);
+		}
+		else
+		{
+			radius = b;
+			angle = 2.f * quarterPi - quarterPi * (a / b);
+		}
+		diskX = radius * std::cos(angle);
+		diskY = radius * std::sin(angle);
+	}
+
+	// The unnormalised direction reaches the focal plane, at camera space z = -focusDistance, after focusDistance
+	const CRTVector lensOffset = lensX * diskX + lensY * diskY;
+	rayOrigin = origin + lensOffset;
+	rayDirection = (topLeft + stepX * px + stepY * py) * focusDistance - lensOffset;
+	rayDirection.normalise();
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "CRTCamera.h"
+
+// Camera rays of one image size, precomputed from the camera position and rotation. Before
+// normalising, the direction through image point (px, py), in pixels from the top-left corner
+// of the image, is topLeft + px * stepX + py * stepY.
+class CRTCameraFrame
+{
+public:
+	// The pose at shutter close, which is the only one of a camera that does not move
+	CRTCameraFrame(const CRTCamera& camera, int imageWidth, int imageHeight);
+	// The pose at time in [0, 1] of the shutter interval
+	CRTCameraFrame(const CRTCamera& camera, int imageWidth, int imageHeight, float time);
+
+	// Linear blend of two frames of the same camera, close enough to the pose in between for nearby poses
+	static CRTCameraFrame interpolate(const CRTCameraFrame& from, const CRTCameraFrame& to, float weight);
+
+	const CRTVector& getOrigin() const;
+	bool hasLens() const;
+
+	// Normalised direction through image point (px, py)
+	CRTVector getDirection(float px, float py) const;
+
+	// Normalised directions through pixels x0 to x1 - 1 of row y, four at a time where SSE is available.
+	// sampleX[i] and sampleY[i] place the sample inside pixel x0 + i, direction i goes to dirX/Y/Z[i].
+	void getRowDirections(int y, int x0, int x1, const float* sampleX, const float* sampleY,
+						  float* dirX, float* dirY, float* dirZ) const;
+
+	// Ray through image point (px, py) from the point of the thin lens that (lensU, lensV) in [0, 1)^2
+	// maps to. The mapping is concentric, so stratified lens samples stay stratified on the disk.
+	void getLensRay(float px, float py, float lensU, float lensV, CRTVector& rayOrigin, CRTVector& rayDirection) const;
+
+private:
+	void init(const CRTMatrix& rotation, const CRTVector& position, int imageWidth, int imageHeight);
+
+	CRTVector origin;
+	CRTVector topLeft;
+	CRTVector stepX;
+	CRTVector stepY;
+	// Lens disk axes scaled by the aperture radius
+	CRTVector lensX;
+	CRTVector lensY;
+	float apertureRadius = 0.f;
+	float focusDistance = 1.f;
+};
@@ -0,0 +1,253 @@
+#include "CRTCompactMesh.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static const float SNORM16_MAX = 32767.f;
+static const float UNORM16_MAX = 65535.f;
+
+template <typename T>
+static size_t getBytes(const std::vector<T>& values)
+{
+	return values.size() * sizeof(T);
+}
+
+void CRTCompactMesh::build(const std::vector<CRTVector>& vertices, const std::vector<int>& indices,
+						   const std::vector<CRTVector>& vertexNormals, const std::vector<CRTVector>& uvs,
+						   bool quantizePositions)
+{
+	*this = CRTCompactMesh();
+
+	// Out of range indices are kept as they are, the renderer skips their triangles
+	const bool fitsIn16Bits = std::all_of(indices.begin(), indices.end(), [](int index) {
+		return index >= 0 && index <= std::numeric_limits<uint16_t>::max();
+	});
+
+	if (fitsIn16Bits)
+		indices16.assign(indices.begin(), indices.end());
+	else
+		indices32 = indices;
+
+	const size_t vertexCount = vertices.size();
+
+	if (quantizePositions)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float minVal = std::numeric_limits<float>::infinity();
+			float maxVal = -std::numeric_limits<float>::infinity();
+			for (const CRTVector& vertex : vertices)
+			{
+				minVal = std::min(minVal, vertex.getByIndex(axis));
+				maxVal = std::max(maxVal, vertex.getByIndex(axis));
+			}
+
+			if (vertexCount == 0)
+				minVal = maxVal = 0.f;
+
+			boundsMin[axis] = minVal;
+			quantizationScale[axis] = (maxVal - minVal) / UNORM16_MAX;
+
+			const float invScale = quantizationScale[axis] > 0.f ? 1.f / quantizationScale[axis] : 0.f;
+			quantizedPositions[axis].resize(vertexCount);
+			for (size_t i = 0; i < vertexCount; i++)
+			{
+				const float q = std::round((vertices[i].getByIndex(axis) - minVal) * invScale);
+				quantizedPositions[axis][i] = static_cast<uint16_t>(std::min(std::max(q, 0.f), UNORM16_MAX));
+			}
+		}
+	}
+	else
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			positions[axis].resize(vertexCount);
+			for (size_t i = 0; i < vertexCount; i++)
+			{
+				positions[axis][i] = vertices[i].getByIndex(axis);
+			}
+		}
+	}
+
+	normalsU.resize(vertexNormals.size());
+	normalsV.resize(vertexNormals.size());
+	for (size_t i = 0; i < vertexNormals.size(); i++)
+	{
+		encodeOctahedral(vertexNormals[i], normalsU[i], normalsV[i]);
+	}
+
+	uvsU.resize(uvs.size());
+	uvsV.resize(uvs.size());
+	for (size_t i = 0; i < uvs.size(); i++)
+	{
+		uvsU[i] = uvs[i].getX();
+		uvsV[i] = uvs[i].getY();
+	}
+}
+
+size_t CRTCompactMesh::getVertexCount() const
+{
+	return std::max(positions[0].size(), quantizedPositions[0].size());
+}
+
+size_t CRTCompactMesh::getIndexCount() const
+{
+	return std::max(indices16.size(), indices32.size());
+}
+
+size_t CRTCompactMesh::getUVCount() const
+{
+	return uvsU.size();
+}
+
+int CRTCompactMesh::getIndex(size_t i) const
+{
+	return indices32.empty() ? indices16[i] : indices32[i];
+}
+
+CRTVector CRTCompactMesh::getVertex(size_t i) const
+{
+	if (quantizedPositions[0].empty())
+	{
+		return CRTVector(positions[0][i], positions[1][i], positions[2][i]);
+	}
+
+	return CRTVector(boundsMin[0] + quantizedPositions[0][i] * quantizationScale[0],
+					 boundsMin[1] + quantizedPositions[1][i] * quantizationScale[1],
+					 boundsMin[2] + quantizedPositions[2][i] * quantizationScale[2]);
+}
+
+CRTVector CRTCompactMesh::getNormal(size_t i) const
+{
+	return decodeOctahedral(normalsU[i], normalsV[i]);
+}
+
+CRTVector CRTCompactMesh::getUV(size_t i) const
+{
+	return CRTVector(uvsU[i], uvsV[i], 0.f);
+}
+
+void CRTCompactMesh::decodeIndices(size_t begin, size_t count, int* out) const
+{
+	if (indices32.empty())
+	{
+		const uint16_t* source = indices16.data() + begin;
+		for (size_t i = 0; i < count; i++)
+		{
+			out[i] = source[i];
+		}
+	}
+	else
+	{
+		std::copy(indices32.begin() + begin, indices32.begin() + begin + count, out);
+	}
+}
+
+void CRTCompactMesh::decodeVertices(size_t begin, size_t count, float* x, float* y, float* z) const
+{
+	float* out[3] = { x, y, z };
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (quantizedPositions[axis].empty())
+		{
+			std::copy(positions[axis].begin() + begin, positions[axis].begin() + begin + count, out[axis]);
+			continue;
+		}
+
+		const uint16_t* source = quantizedPositions[axis].data() + begin;
+		const float offset = boundsMin[axis];
+		const float scale = quantizationScale[axis];
+		float* destination = out[axis];
+		for (size_t i = 0; i < count; i++)
+		{
+			destination[i] = offset + source[i] * scale;
+		}
+	}
+}
+
+void CRTCompactMesh::decodeNormals(size_t begin, size_t count, float* x, float* y, float* z) const
+{
+	const int16_t* sourceU = normalsU.data() + begin;
+	const int16_t* sourceV = normalsV.data() + begin;
+
+	// decodeOctahedral with the sign tests written as copysign, so the loop has no branches
+	for (size_t i = 0; i < count; i++)
+	{
+		float nx = sourceU[i] / SNORM16_MAX;
+		float ny = sourceV[i] / SNORM16_MAX;
+		const float nz = 1.f - std::abs(nx) - std::abs(ny);
+
+		const float t = std::max(-nz, 0.f);
+		nx -= std::copysign(t, nx);
+		ny -= std::copysign(t, ny);
+
+		const float length = std::sqrt(nx * nx + ny * ny + nz * nz);
+		x[i] = nx / length;
+		y[i] = ny / length;
+		z[i] = nz / length;
+	}
+}
+
+size_t CRTCompactMesh::getMemoryBytes() const
+{
+	size_t bytes = getBytes(indices16) + getBytes(indices32) + getBytes(normalsU) + getBytes(normalsV) +
+				   getBytes(uvsU) + getBytes(uvsV);
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		bytes += getBytes(positions[axis]) + getBytes(quantizedPositions[axis]);
+	}
+
+	return bytes;
+}
+
+void CRTCompactMesh::encodeOctahedral(const CRTVector& normal, int16_t& u, int16_t& v)
+{
+	float x = normal.getX();
+	float y = normal.getY();
+	float z = normal.getZ();
+
+	// Vertices no triangle uses have no normal, any direction does for them
+	const float l1Norm = std::abs(x) + std::abs(y) + std::abs(z);
+	if (!(l1Norm > 0.f) || !std::isfinite(l1Norm))
+	{
+		x = 0.f;
+		y = 0.f;
+		z = 1.f;
+	}
+	else
+	{
+		x /= l1Norm;
+		y /= l1Norm;
+		z /= l1Norm;
+	}
+
+	// The lower half of the octahedron is folded over the upper one
+	if (z < 0.f)
+	{
+		const float foldedX = (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f);
+		const float foldedY = (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f);
+		x = foldedX;
+		y = foldedY;
+	}
+
+	u = static_cast<int16_t>(std::round(std::min(std::max(x, -1.f), 1.f) * SNORM16_MAX));
+	v = static_cast<int16_t>(std::round(std::min(std::max(y, -1.f), 1.f) * SNORM16_MAX));
+}
+
+CRTVector CRTCompactMesh::decodeOctahedral(int16_t u, int16_t v)
+{
+	float x = u / SNORM16_MAX;
+	float y = v / SNORM16_MAX;
+	const float z = 1.f - std::abs(x) - std::abs(y);
+
+	// Unfolds the lower half, t is 0 on the upper one
+	const float t = std::max(-z, 0.f);
+	x += x >= 0.f ? -t : t;
+	y += y >= 0.f ? -t : t;
+
+	CRTVector normal(x, y, z);
+	normal.normalise();
+	return normal;
+}
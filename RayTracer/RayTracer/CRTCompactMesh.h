@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Math/CRTVector.h"
+
+// Compact encoding of the shading data of a mesh: 16-bit indices when every index fits,
+// octahedral normals in two 16-bit components, two-component UVs and, optionally, positions
+// quantized to 16 bits relative to the mesh bounds. Every attribute is kept as one array per
+// component. The getters decode one element; the range decoders test the layout once and then
+// run a loop without branches over the component arrays, which the compiler can vectorize.
+class CRTCompactMesh
+{
+public:
+	void build(const std::vector<CRTVector>& vertices, const std::vector<int>& indices,
+			   const std::vector<CRTVector>& vertexNormals, const std::vector<CRTVector>& uvs,
+			   bool quantizePositions);
+
+	size_t getVertexCount() const;
+	size_t getIndexCount() const;
+	size_t getUVCount() const;
+
+	int getIndex(size_t i) const;
+	CRTVector getVertex(size_t i) const;
+	CRTVector getNormal(size_t i) const;
+	// The third component is always 0
+	CRTVector getUV(size_t i) const;
+
+	// Decode elements begin to begin + count into the output arrays
+	void decodeIndices(size_t begin, size_t count, int* out) const;
+	void decodeVertices(size_t begin, size_t count, float* x, float* y, float* z) const;
+	void decodeNormals(size_t begin, size_t count, float* x, float* y, float* z) const;
+
+	size_t getMemoryBytes() const;
+
+	static void encodeOctahedral(const CRTVector& normal, int16_t& u, int16_t& v);
+	static CRTVector decodeOctahedral(int16_t u, int16_t v);
+
+private:
+	// Only one of each pair is filled
+	std::vector<uint16_t> indices16;
+	std::vector<int> indices32;
+
+	std::vector<float> positions[3];
+	std::vector<uint16_t> quantizedPositions[3];
+	float boundsMin[3] = { 0.f, 0.f, 0.f };
+	float quantizationScale[3] = { 0.f, 0.f, 0.f };
+
+	std::vector<int16_t> normalsU;
+	std::vector<int16_t> normalsV;
+
+	std::vector<float> uvsU;
+	std::vector<float> uvsV;
+};
@@ -0,0 +1,191 @@
+#include "CRTCoordinator.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include "CRTImage.h"
+#include "CRTProcess.h"
+#include "CRTTimeline.h"
+
+CRTCoordinator::CRTCoordinator(const std::string& sceneFile, int imageWidth, int imageHeight,
+							   const CRTCoordinatorSettings& settings)
+	: sceneFile(sceneFile), imageWidth(imageWidth), imageHeight(imageHeight), settings(settings)
+{
+	this->settings.workers = std::max(1, settings.workers);
+	this->settings.jobSize = std::max(Renderer::TILE_SIZE, settings.jobSize);
+	this->settings.framesPerJob = std::max(1, settings.framesPerJob);
+	this->settings.maxAttempts = std::max(1, settings.maxAttempts);
+}
+
+bool CRTCoordinator::renderScene(const std::string& outputFile) const
+{
+	std::vector<Job> jobs;
+
+	for (int y = 0; y < imageHeight; y += settings.jobSize)
+	{
+		for (int x = 0; x < imageWidth; x += settings.jobSize)
+		{
+			Job job;
+			job.isRegion = true;
+			job.region.x0 = x;
+			job.region.y0 = y;
+			job.region.x1 = std::min(x + settings.jobSize, imageWidth);
+			job.region.y1 = std::min(y + settings.jobSize, imageHeight);
+			const std::string partBaseName = outputFile + ".part" + std::to_string(jobs.size());
+			job.resultFiles.push_back(partBaseName + ".ppm");
+			if (settings.sampleCountImage)
+				job.resultFiles.push_back(partBaseName + "_spp.ppm");
+			job.arguments = { job.resultFiles[0], "--region",
+				std::to_string(job.region.x0), std::to_string(job.region.y0),
+				std::to_string(job.region.x1), std::to_string(job.region.y1) };
+			jobs.push_back(job);
+		}
+	}
+
+	const bool succeeded = runJobs(jobs);
+
+	if (succeeded)
+	{
+		CRT_TIMELINE_ZONE("merge regions");
+
+		// The frame, then with --aa the sample counts next to it like Renderer::renderScene writes them
+		const size_t imageCount = jobs.empty() ? 0 : jobs[0].resultFiles.size();
+		for (size_t imageIdx = 0; imageIdx < imageCount; imageIdx++)
+		{
+			CRTImage image(imageWidth, imageHeight);
+			for (const Job& job : jobs)
+			{
+				CRTImage part;
+				part.read(job.resultFiles[imageIdx]);
+				image.paste(part, job.region.x0, job.region.y0);
+			}
+
+			image.write(imageIdx == 0 ? outputFile : outputFile.substr(0, outputFile.find_last_of('.')) + "_spp.ppm");
+		}
+	}
+
+	for (const Job& job : jobs)
+	{
+		removeFiles(job);
+	}
+
+	return succeeded;
+}
+
+bool CRTCoordinator::renderAnimation(const std::string& outputFileBaseName) const
+{
+	std::vector<Job> jobs;
+
+	for (int first = 0; first < Renderer::ANIMATION_FRAME_COUNT; first += settings.framesPerJob)
+	{
+		const int count = std::min(settings.framesPerJob, Renderer::ANIMATION_FRAME_COUNT - first);
+
+		Job job;
+		for (int k = first; k < first + count; k++)
+		{
+			job.resultFiles.push_back(outputFileBaseName + std::to_string(k) + ".ppm");
+		}
+		// The worker takes the output file without its extension as the base name of the frames
+		job.arguments = { outputFileBaseName + ".ppm", "--animation", "--frames",
+			std::to_string(first), std::to_string(count) };
+		jobs.push_back(job);
+	}
+
+	return runJobs(jobs);
+}
+
+bool CRTCoordinator::runJobs(const std::vector<Job>& jobs) const
+{
+	CRT_TIMELINE_ZONE("coordinate jobs");
+
+	std::atomic<int> nextJob(0);
+	std::atomic<int> jobsDone(0);
+	std::atomic<bool> failed(false);
+	std::mutex outputMutex;
+
+	auto worker = [&]() {
+		while (!failed)
+		{
+			int jobIdx = nextJob++;
+			if (jobIdx >= static_cast<int>(jobs.size()))
+			{
+				break;
+			}
+
+			int attempt = 1;
+			while (!runJob(jobs[jobIdx]))
+			{
+				std::lock_guard<std::mutex> lock(outputMutex);
+				if (attempt == settings.maxAttempts)
+				{
+					std::cout << "Job " << jobIdx << " failed " << attempt << " times, giving up" << std::endl;
+					failed = true;
+					break;
+				}
+
+				std::cout << "Job " << jobIdx << " failed, starting it again" << std::endl;
+				attempt++;
+			}
+
+			if (failed)
+			{
+				break;
+			}
+
+			std::lock_guard<std::mutex> lock(outputMutex);
+			std::cout << "Job " << jobIdx << " done (" << ++jobsDone << "/" << jobs.size() << ")" << std::endl;
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < std::min(settings.workers, static_cast<int>(jobs.size())); i++)
+	{
+		threads.emplace_back(worker);
+	}
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	return !failed;
+}
+
+bool CRTCoordinator::runJob(const Job& job) const
+{
+	// Leftovers of an earlier attempt must not pass for results
+	removeFiles(job);
+
+	std::vector<std::string> command = { settings.workerExecutable, sceneFile };
+	command.insert(command.end(), job.arguments.begin(), job.arguments.end());
+	command.insert(command.end(), settings.workerArguments.begin(), settings.workerArguments.end());
+
+	return CRTProcess::run(command) == 0 && isJobComplete(job);
+}
+
+void CRTCoordinator::removeFiles(const Job& job) const
+{
+	for (const std::string& resultFile : job.resultFiles)
+	{
+		std::remove(resultFile.c_str());
+	}
+}
+
+bool CRTCoordinator::isJobComplete(const Job& job) const
+{
+	const int width = job.isRegion ? job.region.x1 - job.region.x0 : imageWidth;
+	const int height = job.isRegion ? job.region.y1 - job.region.y0 : imageHeight;
+
+	for (const std::string& resultFile : job.resultFiles)
+	{
+		CRTImage image;
+		if (!image.read(resultFile) || image.getWidth() != width || image.getHeight() != height)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "Renderer.h"
+
+struct CRTCoordinatorSettings
+{
+	std::string workerExecutable; //Program started for every job, normally this executable
+	std::vector<std::string> workerArguments; //Render options passed on to every worker
+	int workers = 4; //Worker processes running at the same time
+	int jobSize = 256; //Edge in pixels of the regions a frame is split into
+	int framesPerJob = 4; //Animation frames rendered by one job
+	int maxAttempts = 3; //Starts of a job before the render is given up
+	bool sampleCountImage = false; //Workers render with --aa, their _spp.ppm images are merged as well
+};
+
+// Splits a frame into regions, or the animation into frame ranges, and renders them
+// in separate worker processes. The protocol is the argument vector, see CRTProcess: a job is
+//   <worker> <scene file> <result file> --region <x0> <y0> <x1> <y1> <worker arguments>
+//   <worker> <scene file> <result file> --animation --frames <first> <count> <worker arguments>
+// and it succeeded when the worker exits with 0 and its result images are complete.
+// Failed jobs are started again. Every pixel renders the same in any region, so the merged
+// frame is identical to a single-process render. Only complete frames and animations are
+// coordinated, progressive, heatmap and region renders run in a single process.
+class CRTCoordinator
+{
+public:
+	CRTCoordinator(const std::string& sceneFile, int imageWidth, int imageHeight,
+				   const CRTCoordinatorSettings& settings);
+
+	// False when a job failed maxAttempts times, the output file is not written then
+	bool renderScene(const std::string& outputFile) const;
+	// Writes <base><frame>.ppm like Renderer::renderAnimation
+	bool renderAnimation(const std::string& outputFileBaseName) const;
+
+private:
+	struct Job
+	{
+		// Worker arguments after the scene file
+		std::vector<std::string> arguments;
+		// Images the worker writes, all of them imageWidth x imageHeight unless region is set
+		std::vector<std::string> resultFiles;
+		CRTRenderRegion region;
+		bool isRegion = false;
+	};
+
+	std::string sceneFile;
+	int imageWidth;
+	int imageHeight;
+	CRTCoordinatorSettings settings;
+
+	bool runJobs(const std::vector<Job>& jobs) const;
+	bool runJob(const Job& job) const;
+	bool isJobComplete(const Job& job) const;
+	void removeFiles(const Job& job) const;
+};
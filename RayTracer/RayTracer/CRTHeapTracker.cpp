@@ -0,0 +1,103 @@
+#include "CRTHeapTracker.h"
+
+#ifdef CRT_ENABLE_ALLOCATION_TRACKING
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+static thread_local long long threadAllocations = 0;
+static std::atomic<long long> bytesInUse(0);
+static std::atomic<long long> peakBytes(0);
+
+// Every allocation starts with a header holding its size, so delete knows what it frees
+static const size_t HEADER_SIZE = alignof(std::max_align_t);
+
+bool CRTHeapTracker::isEnabled()
+{
+	return true;
+}
+
+long long CRTHeapTracker::getThreadAllocations()
+{
+	return threadAllocations;
+}
+
+long long CRTHeapTracker::getBytesInUse()
+{
+	return bytesInUse;
+}
+
+long long CRTHeapTracker::getPeakBytes()
+{
+	return peakBytes;
+}
+
+void CRTHeapTracker::resetPeakBytes()
+{
+	peakBytes = bytesInUse.load();
+}
+
+// Counting replacements of the global allocation functions, the array and nothrow forms forward here
+void* operator new(size_t bytes)
+{
+	threadAllocations++;
+
+	void* memory = std::malloc(bytes + HEADER_SIZE);
+	if (!memory)
+		throw std::bad_alloc();
+
+	*static_cast<size_t*>(memory) = bytes;
+
+	const long long inUse = bytesInUse += static_cast<long long>(bytes);
+	long long peak = peakBytes;
+	while (inUse > peak && !peakBytes.compare_exchange_weak(peak, inUse))
+	{
+	}
+
+	return static_cast<char*>(memory) + HEADER_SIZE;
+}
+
+void operator delete(void* memory) noexcept
+{
+	if (!memory)
+		return;
+
+	void* allocation = static_cast<char*>(memory) - HEADER_SIZE;
+	bytesInUse -= static_cast<long long>(*static_cast<size_t*>(allocation));
+	std::free(allocation);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	operator delete(memory);
+}
+
+#else
+
+bool CRTHeapTracker::isEnabled()
+{
+	return false;
+}
+
+long long CRTHeapTracker::getThreadAllocations()
+{
+	return 0;
+}
+
+long long CRTHeapTracker::getBytesInUse()
+{
+	return 0;
+}
+
+long long CRTHeapTracker::getPeakBytes()
+{
+	return 0;
+}
+
+void CRTHeapTracker::resetPeakBytes()
+{
+}
+
+#endif
@@ -0,0 +1,19 @@
+#pragma once
+
+// Counts what goes through the global operator new and delete, to check that hot paths do not
+// allocate and to measure what loading a scene costs. Compiled in only with
+// CRT_ENABLE_ALLOCATION_TRACKING (add it to the preprocessor definitions of the configuration);
+// otherwise nothing is replaced and every counter reads 0.
+class CRTHeapTracker
+{
+public:
+	static bool isEnabled();
+
+	// Allocations made by the calling thread since it started
+	static long long getThreadAllocations();
+
+	// Bytes allocated and not yet freed by all threads, and the most there were since the last reset
+	static long long getBytesInUse();
+	static long long getPeakBytes();
+	static void resetPeakBytes();
+};
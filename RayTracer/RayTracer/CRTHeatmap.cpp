@@ -0,0 +1,103 @@
+#include "CRTHeatmap.h"
+#include <algorithm>
+#include <fstream>
+#include "CRTTimeline.h"
+
+static const char* channelNames[CRTHeatmap::CHANNEL_COUNT] = {
+	"triangles", "boxes", "secondary"
+};
+
+CRTVector CRTHeatmap::mapColor(float value)
+{
+	static const CRTVector ramp[] = {
+		CRTVector(0.f, 0.f, 1.f),
+		CRTVector(0.f, 1.f, 1.f),
+		CRTVector(0.f, 1.f, 0.f),
+		CRTVector(1.f, 1.f, 0.f),
+		CRTVector(1.f, 0.f, 0.f)
+	};
+	const int lastIdx = sizeof(ramp) / sizeof(ramp[0]) - 1;
+
+	float scaled = std::min(std::max(value, 0.f), 1.f) * lastIdx;
+	int idx = std::min(static_cast<int>(scaled), lastIdx - 1);
+	float t = scaled - idx;
+
+	return ramp[idx] * (1.f - t) + ramp[idx + 1] * t;
+}
+
+void CRTHeatmap::resize(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+	values.assign(static_cast<size_t>(width) * height * CHANNEL_COUNT, 0.f);
+}
+
+void CRTHeatmap::record(int x, int y, const CRTRenderStats& pixelStats)
+{
+	const long long cameraRays = pixelStats.raysByType[static_cast<int>(CRTRayType::CAMERA)];
+
+	float* pixel = &values[(static_cast<size_t>(y) * width + x) * CHANNEL_COUNT];
+	pixel[TRIANGLE_TESTS] = static_cast<float>(pixelStats.triangleTests);
+	pixel[BOX_TESTS] = static_cast<float>(pixelStats.boxTests);
+	pixel[SECONDARY_RAYS] = static_cast<float>(pixelStats.getTotalRays() - cameraRays);
+}
+
+float CRTHeatmap::getValue(int x, int y, Channel channel) const
+{
+	return values[(static_cast<size_t>(y) * width + x) * CHANNEL_COUNT + channel];
+}
+
+float CRTHeatmap::getMaxValue(Channel channel) const
+{
+	float maxValue = 0.f;
+	for (size_t i = channel; i < values.size(); i += CHANNEL_COUNT)
+	{
+		maxValue = std::max(maxValue, values[i]);
+	}
+
+	return maxValue;
+}
+
+void CRTHeatmap::writeImages(const std::string& outputFileBaseName) const
+{
+	for (int c = 0; c < CHANNEL_COUNT; c++)
+	{
+		Channel channel = static_cast<Channel>(c);
+		writeImage(outputFileBaseName + "_" + channelNames[c] + ".ppm", channel);
+	}
+}
+
+void CRTHeatmap::writeImage(const std::string& fileName, Channel channel) const
+{
+	CRT_TIMELINE_ZONE("write heatmap");
+
+	// Linear scale, the maximum of the channel maps to red
+	const float maxValue = getMaxValue(channel);
+	const float invMax = maxValue > 0.f ? 1.f / maxValue : 0.f;
+
+	std::ofstream ofs(fileName);
+	ofs << "P3\n" << width << " " << height << "\n255\n";
+
+	for (int j = 0; j < height; j++)
+	{
+		for (int i = 0; i < width; i++)
+		{
+			CRTVector color = mapColor(getValue(i, j, channel) * invMax);
+			ofs << static_cast<int>(color.getX() * 255.f) << " "
+				<< static_cast<int>(color.getY() * 255.f) << " "
+				<< static_cast<int>(color.getZ() * 255.f) << "\t";
+		}
+		ofs << "\n";
+	}
+}
+
+void CRTHeatmap::writeRaw(const std::string& fileName) const
+{
+	std::ofstream ofs(fileName, std::ios::binary);
+	ofs.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(float));
+}
+
+const char* CRTHeatmap::getChannelName(Channel channel)
+{
+	return channelNames[channel];
+}
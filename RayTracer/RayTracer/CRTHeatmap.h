@@ -0,0 +1,43 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "CRTRenderStats.h"
+#include "Math/CRTVector.h"
+
+// Per-pixel traversal cost of a render: triangle tests, box tests and secondary rays
+// (shadow, reflection and refraction) spent on the camera ray of every pixel.
+// Each pixel is written by exactly one render thread, so recording needs no locking.
+class CRTHeatmap
+{
+public:
+	enum Channel
+	{
+		TRIANGLE_TESTS,
+		BOX_TESTS,
+		SECONDARY_RAYS,
+		CHANNEL_COUNT
+	};
+
+	void resize(int width, int height);
+	void record(int x, int y, const CRTRenderStats& pixelStats);
+
+	float getValue(int x, int y, Channel channel) const;
+	float getMaxValue(Channel channel) const;
+
+	// One colour-mapped P3 image per channel: <base>_triangles.ppm, <base>_boxes.ppm, <base>_secondary.ppm
+	void writeImages(const std::string& outputFileBaseName) const;
+
+	// Headerless little-endian float32 dump, rows top to bottom, CHANNEL_COUNT values per pixel
+	void writeRaw(const std::string& fileName) const;
+
+	static const char* getChannelName(Channel channel);
+
+	// Blue - cyan - green - yellow - red ramp, value is clamped to [0, 1]
+	static CRTVector mapColor(float value);
+private:
+	int width = 0;
+	int height = 0;
+	std::vector<float> values;
+
+	void writeImage(const std::string& fileName, Channel channel) const;
+};
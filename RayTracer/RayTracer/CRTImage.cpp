@@ -0,0 +1,91 @@
+#include "CRTImage.h"
+#include <algorithm>
+#include <fstream>
+
+CRTImage::CRTImage(int width, int height)
+	: width(width), height(height), pixels(static_cast<size_t>(width) * height * 3, 0)
+{
+}
+
+int CRTImage::getWidth() const
+{
+	return width;
+}
+
+int CRTImage::getHeight() const
+{
+	return height;
+}
+
+void CRTImage::setPixel(int x, int y, int r, int g, int b)
+{
+	uint8_t* pixel = &pixels[(static_cast<size_t>(y) * width + x) * 3];
+	pixel[0] = static_cast<uint8_t>(r);
+	pixel[1] = static_cast<uint8_t>(g);
+	pixel[2] = static_cast<uint8_t>(b);
+}
+
+void CRTImage::paste(const CRTImage& source, int x, int y)
+{
+	const int x0 = std::max(x, 0);
+	const int x1 = std::min(x + source.width, width);
+	if (x0 >= x1)
+		return;
+
+	for (int j = std::max(y, 0); j < std::min(y + source.height, height); j++)
+	{
+		const uint8_t* from = &source.pixels[(static_cast<size_t>(j - y) * source.width + (x0 - x)) * 3];
+		std::copy(from, from + (x1 - x0) * 3, &pixels[(static_cast<size_t>(j) * width + x0) * 3]);
+	}
+}
+
+bool CRTImage::read(const std::string& fileName)
+{
+	std::ifstream ifs(fileName);
+	std::string magic;
+	int newWidth = 0;
+	int newHeight = 0;
+	int maxValue = 0;
+
+	if (!(ifs >> magic >> newWidth >> newHeight >> maxValue) || magic != "P3" ||
+		newWidth <= 0 || newHeight <= 0 || maxValue != 255)
+		return false;
+
+	std::vector<uint8_t> newPixels(static_cast<size_t>(newWidth) * newHeight * 3);
+	for (uint8_t& value : newPixels)
+	{
+		int component = 0;
+		if (!(ifs >> component) || component < 0 || component > 255)
+			return false;
+
+		value = static_cast<uint8_t>(component);
+	}
+
+	width = newWidth;
+	height = newHeight;
+	pixels.swap(newPixels);
+	return true;
+}
+
+bool CRTImage::write(const std::string& fileName) const
+{
+	std::ofstream ofs(fileName);
+	ofs << "P3\n" << width << " " << height << "\n255\n";
+
+	const uint8_t* pixel = pixels.data();
+	for (int j = 0; j < height; j++)
+	{
+		for (int i = 0; i < width; i++, pixel += 3)
+		{
+			ofs << int(pixel[0]) << ' ' << int(pixel[1]) << ' ' << int(pixel[2]) << '\t';
+		}
+		ofs << "\n";
+	}
+
+	return static_cast<bool>(ofs);
+}
+
+bool CRTImage::operator==(const CRTImage& other) const
+{
+	return width == other.width && height == other.height && pixels == other.pixels;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 8-bit RGB image in the P3 layout the renderer writes: one line per row, a tab after every pixel.
+// Used to crop, patch and merge rendered regions without converting the pixels back to floats.
+class CRTImage
+{
+public:
+	CRTImage() = default;
+	CRTImage(int width, int height);
+
+	int getWidth() const;
+	int getHeight() const;
+
+	void setPixel(int x, int y, int r, int g, int b);
+
+	// Copies source into this image with its top-left corner at (x, y), clipped to this image
+	void paste(const CRTImage& source, int x, int y);
+
+	// Reads a P3 image with a maximum value of 255, false if the file is missing or malformed
+	bool read(const std::string& fileName);
+	bool write(const std::string& fileName) const;
+
+	bool operator==(const CRTImage& other) const;
+private:
+	int width = 0;
+	int height = 0;
+	std::vector<uint8_t> pixels;
+};
@@ -0,0 +1,167 @@
+#include "CRTLightTree.h"
+#include <algorithm>
+
+static const float PI = 3.14159265f;
+
+void CRTLightTree::build(const std::vector<CRTLight>& lights)
+{
+	clear();
+
+	if (lights.empty())
+		return;
+
+	positions.reserve(lights.size());
+	intensities.reserve(lights.size());
+	for (const CRTLight& light : lights)
+	{
+		positions.push_back(light.getPosition());
+		intensities.push_back(light.getIntensity());
+	}
+
+	std::vector<int> lightIndices(lights.size());
+	for (size_t i = 0; i < lightIndices.size(); i++)
+	{
+		lightIndices[i] = static_cast<int>(i);
+	}
+
+	nodes.reserve(2 * lights.size() - 1);
+	buildNode(lightIndices, 0, static_cast<int>(lightIndices.size()));
+}
+
+void CRTLightTree::clear()
+{
+	nodes.clear();
+	positions.clear();
+	intensities.clear();
+}
+
+bool CRTLightTree::isEmpty() const
+{
+	return nodes.empty();
+}
+
+int CRTLightTree::buildNode(std::vector<int>& lightIndices, int begin, int end)
+{
+	const int nodeIdx = static_cast<int>(nodes.size());
+	nodes.push_back(Node());
+
+	Node node;
+	node.intensity = 0.f;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		node.boundsMin[axis] = positions[lightIndices[begin]].getByIndex(axis);
+		node.boundsMax[axis] = node.boundsMin[axis];
+	}
+
+	for (int i = begin; i < end; i++)
+	{
+		const CRTVector& position = positions[lightIndices[i]];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			node.boundsMin[axis] = std::min(node.boundsMin[axis], position.getByIndex(axis));
+			node.boundsMax[axis] = std::max(node.boundsMax[axis], position.getByIndex(axis));
+		}
+		node.intensity += intensities[lightIndices[i]];
+	}
+
+	if (end - begin == 1)
+	{
+		node.child = -(lightIndices[begin] + 1);
+		nodes[nodeIdx] = node;
+		return nodeIdx;
+	}
+
+	int splitAxis = 0;
+	for (int axis = 1; axis < 3; axis++)
+	{
+		if (node.boundsMax[axis] - node.boundsMin[axis] > node.boundsMax[splitAxis] - node.boundsMin[splitAxis])
+			splitAxis = axis;
+	}
+
+	const int middle = begin + (end - begin) / 2;
+	std::nth_element(lightIndices.begin() + begin, lightIndices.begin() + middle, lightIndices.begin() + end,
+		[&](int lhs, int rhs) {
+			return positions[lhs].getByIndex(splitAxis) < positions[rhs].getByIndex(splitAxis);
+		});
+
+	buildNode(lightIndices, begin, middle);
+	node.child = buildNode(lightIndices, middle, end);
+	nodes[nodeIdx] = node;
+
+	return nodeIdx;
+}
+
+int CRTLightTree::sample(const CRTVector& point, float u, float cullThreshold, float& pdf) const
+{
+	pdf = 0.f;
+	if (nodes.empty())
+		return -1;
+
+	float probability = 1.f;
+	int nodeIdx = 0;
+
+	if (getImportance(nodes[0], point, cullThreshold) <= 0.f)
+		return -1;
+
+	while (!isLeaf(nodes[nodeIdx]))
+	{
+		const int leftIdx = nodeIdx + 1;
+		const int rightIdx = nodes[nodeIdx].child;
+
+		const float leftImportance = getImportance(nodes[leftIdx], point, cullThreshold);
+		const float rightImportance = getImportance(nodes[rightIdx], point, cullThreshold);
+		const float totalImportance = leftImportance + rightImportance;
+
+		if (totalImportance <= 0.f)
+			return -1;
+
+		// u is reused for the next level after rescaling to [0, 1)
+		const float leftProbability = leftImportance / totalImportance;
+		if (u < leftProbability)
+		{
+			u = std::min(u / leftProbability, 0x1.fffffep-1f);
+			probability *= leftProbability;
+			nodeIdx = leftIdx;
+		}
+		else
+		{
+			u = std::min((u - leftProbability) / (1.f - leftProbability), 0x1.fffffep-1f);
+			probability *= 1.f - leftProbability;
+			nodeIdx = rightIdx;
+		}
+	}
+
+	pdf = probability;
+	return getLightIdx(nodes[nodeIdx]);
+}
+
+float CRTLightTree::getImportance(const Node& node, const CRTVector& point, float cullThreshold) const
+{
+	// Squared distance from the point to the box, the closest any light of the node can be
+	float distanceSq = 0.f;
+	float extentSq = 0.f;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const float p = point.getByIndex(axis);
+		const float d = std::max(std::max(node.boundsMin[axis] - p, p - node.boundsMax[axis]), 0.f);
+		const float extent = node.boundsMax[axis] - node.boundsMin[axis];
+		distanceSq += d * d;
+		extentSq += extent * extent;
+	}
+
+	if (cullThreshold > 0.f && node.intensity < cullThreshold * 4.f * PI * distanceSq)
+		return 0.f;
+
+	// Inside or close to a large box the distance says little, clamp it to half the box diagonal
+	return node.intensity / std::max(distanceSq, std::max(0.25f * extentSq, 1e-8f));
+}
+
+bool CRTLightTree::isLeaf(const Node& node)
+{
+	return node.child < 0;
+}
+
+int CRTLightTree::getLightIdx(const Node& node)
+{
+	return -node.child - 1;
+}
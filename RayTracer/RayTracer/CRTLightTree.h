@@ -0,0 +1,78 @@
+#pragma once
+#include <vector>
+#include "CRTLight.h"
+
+// Binary tree over the point lights of a scene, split at the median of the widest axis.
+// Every node keeps the bounding box and the summed intensity of its lights, which bounds
+// what the subtree can contribute at a point. That bound drives both importance sampling
+// (descend towards the brighter and closer child) and culling (skip subtrees whose
+// intensity / (4 * pi * r^2) at the shading point is below a threshold).
+class CRTLightTree
+{
+public:
+	void build(const std::vector<CRTLight>& lights);
+	void clear();
+	bool isEmpty() const;
+
+	// Picks one light with probability roughly proportional to its contribution at point.
+	// u is uniform in [0, 1). Returns the light index and its probability in pdf,
+	// or -1 when every light is culled.
+	int sample(const CRTVector& point, float u, float cullThreshold, float& pdf) const;
+
+	// Calls visit(lightIdx) for every light whose contribution at point can reach cullThreshold
+	template <typename Visitor>
+	void forEachLight(const CRTVector& point, float cullThreshold, Visitor&& visit) const;
+
+private:
+	struct Node
+	{
+		float boundsMin[3];
+		float boundsMax[3];
+		float intensity;
+		// Inner nodes: index of the right child, the left one follows the node.
+		// Leaves: index of the light, stored as -(lightIdx + 1)
+		int child;
+	};
+
+	std::vector<Node> nodes;
+	std::vector<CRTVector> positions;
+	std::vector<float> intensities;
+
+	int buildNode(std::vector<int>& lightIndices, int begin, int end);
+
+	// Largest contribution the lights of the node can have at point, 0 when below the threshold
+	float getImportance(const Node& node, const CRTVector& point, float cullThreshold) const;
+
+	static bool isLeaf(const Node& node);
+	static int getLightIdx(const Node& node);
+};
+
+template <typename Visitor>
+void CRTLightTree::forEachLight(const CRTVector& point, float cullThreshold, Visitor&& visit) const
+{
+	if (nodes.empty())
+		return;
+
+	int stack[64];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const int nodeIdx = stack[--stackSize];
+		const Node& node = nodes[nodeIdx];
+
+		if (getImportance(node, point, cullThreshold) <= 0.f)
+			continue;
+
+		if (isLeaf(node))
+		{
+			visit(getLightIdx(node));
+		}
+		else
+		{
+			stack[stackSize++] = node.child;
+			stack[stackSize++] = nodeIdx + 1;
+		}
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file, released with the object
+class CRTMappedFile
+{
+public:
+	CRTMappedFile() = default;
+	CRTMappedFile(const CRTMappedFile& other) = delete;
+	CRTMappedFile& operator=(const CRTMappedFile& other) = delete;
+	~CRTMappedFile();
+
+	bool open(const std::string& fileName);
+	void close();
+
+	const unsigned char* getData() const;
+	size_t getSize() const;
+
+private:
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#endif
+};
@@ -1,4 +1,5 @@
 #include "CRTMesh.h"
+#include <cstdio>
 #include <iostream>
 #include "Math/CRTTriangle.h"
 
@@ -22,40 +23,67 @@ void CRTMesh::addUV(const CRTVector& uv)
 	uvData.push_back(uv);
 }
 
+void CRTMesh::reserve(size_t vertexCount, size_t indexCount, size_t uvCount)
+{
+	vertices.reserve(vertexCount);
+	indices.reserve(indexCount);
+	uvData.reserve(uvCount);
+}
+
 void CRTMesh::print() const
 {
-	for (const auto& obj : vertices)
+	for (size_t i = 0; i < getVertexCount(); i++)
 	{
-		obj.print(std::cout);
+		getVertex(i).print(std::cout);
 	}
 
-	for (int i=0;i<indices.size();i++)
+	for (size_t i = 0; i < getIndexCount(); i++)
 	{
 		if (i % 3 == 0)
 			std::cout << std::endl;
 
-		std::cout << indices[i] << ' ';
+		std::cout << getIndex(i) << ' ';
 	}
 }
 
-const std::vector<CRTVector>& CRTMesh::getVertices() const
+size_t CRTMesh::getVertexCount() const
+{
+	return compacted ? compactData.getVertexCount() : vertices.size();
+}
+
+size_t CRTMesh::getIndexCount() const
 {
-	return vertices;
+	return compacted ? compactData.getIndexCount() : indices.size();
 }
 
-const std::vector<int>& CRTMesh::getIndices() const
+int CRTMesh::getIndex(size_t i) const
 {
-	return indices;
+	return compacted ? compactData.getIndex(i) : indices[i];
 }
 
-const std::vector<CRTVector>& CRTMesh::getVertexNormals() const
+CRTVector CRTMesh::getVertex(size_t i) const
 {
-	return vertexNormals;
+	return compacted ? compactData.getVertex(i) : vertices[i];
 }
 
-const std::vector<CRTVector>& CRTMesh::getUV() const
+CRTVector CRTMesh::getVertexNormal(size_t i) const
 {
-	return uvData;
+	return compacted ? compactData.getNormal(i) : vertexNormals[i];
+}
+
+CRTVector CRTMesh::getUV(size_t i) const
+{
+	return compacted ? compactData.getUV(i) : uvData[i];
+}
+
+const CRTTriangleStream& CRTMesh::getTriangleStream() const
+{
+	return triangleStream;
+}
+
+const CRTBVH& CRTMesh::getBVH() const
+{
+	return bvh;
 }
 
 int CRTMesh::getMaterialIndex() const
@@ -92,3 +120,82 @@ void CRTMesh::calculateVertexNormals()
 	}
 
 }
+
+void CRTMesh::buildTriangleStream()
+{
+	triangleStream.build(vertices, indices);
+}
+
+void CRTMesh::buildBVH(CRTBVHLayout layout, const std::string& cacheDirectory)
+{
+	if (triangleStream.getTriangleCount() < CRTBVH::MIN_TRIANGLES || (!bvh.isEmpty() && bvh.getLayout() == layout))
+		return;
+
+	if (cacheDirectory.empty())
+	{
+		bvh.build(triangleStream, layout);
+		return;
+	}
+
+	const uint64_t key = CRTBVH::getCacheKey(triangleStream, layout);
+	char keyText[17];
+	std::snprintf(keyText, sizeof(keyText), "%016llx", static_cast<unsigned long long>(key));
+	const std::string cacheFile = cacheDirectory + "/" + keyText + ".bvh";
+
+	const uint64_t checksum = CRTBVH::getCacheChecksum(triangleStream);
+	if (bvh.loadCache(cacheFile, key, checksum))
+		return;
+
+	bvh.build(triangleStream, layout);
+	bvh.saveCache(cacheFile, key, checksum);
+}
+
+void CRTMesh::compact(bool quantizePositions)
+{
+	if (compacted)
+		return;
+
+	compactData.build(vertices, indices, vertexNormals, uvData, quantizePositions);
+	compacted = true;
+
+	if (quantizePositions)
+	{
+		std::vector<float> decoded[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			decoded[axis].resize(vertices.size());
+		}
+		compactData.decodeVertices(0, vertices.size(), decoded[0].data(), decoded[1].data(), decoded[2].data());
+
+		std::vector<CRTVector> decodedVertices;
+		decodedVertices.reserve(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			decodedVertices.push_back(CRTVector(decoded[0][i], decoded[1][i], decoded[2][i]));
+		}
+
+		// A BVH built over the old stream no longer bounds its triangles
+		triangleStream.build(decodedVertices, indices);
+		bvh.clear();
+	}
+
+	// swap() releases the memory, clear() would keep it
+	std::vector<CRTVector>().swap(vertices);
+	std::vector<int>().swap(indices);
+	std::vector<CRTVector>().swap(vertexNormals);
+	std::vector<CRTVector>().swap(uvData);
+}
+
+bool CRTMesh::isCompact() const
+{
+	return compacted;
+}
+
+size_t CRTMesh::getVertexDataBytes() const
+{
+	if (compacted)
+		return compactData.getMemoryBytes() + triangleStream.getMemoryBytes();
+
+	return (vertices.size() + vertexNormals.size() + uvData.size()) * sizeof(CRTVector) + indices.size() * sizeof(int) +
+		triangleStream.getMemoryBytes();
+}
@@ -1,6 +1,10 @@
 #pragma once
+#include <string>
 #include <vector>
 #include "Math/CRTVector.h"
+#include "CRTTriangleStream.h"
+#include "CRTCompactMesh.h"
+#include "CRTBVH.h"
 
 
 class CRTMesh
@@ -11,22 +15,44 @@ public:
 	void addIndex(int index);
 	void setMaterialIndex(int index);
 	void addUV(const CRTVector& uv);
+	// Sizes the buffers up front so filling them from a scene file never reallocates
+	void reserve(size_t vertexCount, size_t indexCount, size_t uvCount);
 
 	void print() const;
-	const std::vector<CRTVector>& getVertices() const;
-	const std::vector<int>& getIndices() const;
-	const std::vector<CRTVector>& getVertexNormals() const;
-	const std::vector<CRTVector>& getUV() const;
+	size_t getVertexCount() const;
+	size_t getIndexCount() const;
+	int getIndex(size_t i) const;
+	CRTVector getVertex(size_t i) const;
+	CRTVector getVertexNormal(size_t i) const;
+	CRTVector getUV(size_t i) const;
+	const CRTTriangleStream& getTriangleStream() const;
+	// Empty for meshes under CRTBVH::MIN_TRIANGLES triangles and until buildBVH() ran
+	const CRTBVH& getBVH() const;
 	int getMaterialIndex() const;
 
+	// Replaces the vertex, index, normal and UV buffers with their compact encoding. The triangle
+	// stream stays in floats for the kernels but is rebuilt from the compact positions, so quantized
+	// meshes are intersected and shaded as the same geometry. Meshes already compact stay as they are.
+	void compact(bool quantizePositions);
+	bool isCompact() const;
+	// Bytes of the vertex, index, normal and UV data and of the triangle stream, the BVH is not counted
+	size_t getVertexDataBytes() const;
 
 	void calculateVertexNormals();
+	void buildTriangleStream();
+	// Builds the BVH over the triangle stream, a BVH of the same layout is kept. With a cache directory
+	// the BVH is mapped from the cache file of its key when there is one, and written there when not.
+	void buildBVH(CRTBVHLayout layout, const std::string& cacheDirectory = std::string());
 
 private:
 	std::vector<CRTVector> vertices;
 	std::vector<int> indices;
 	std::vector<CRTVector> vertexNormals;
 	std::vector<CRTVector> uvData;
+	CRTTriangleStream triangleStream;
+	CRTBVH bvh;
+	CRTCompactMesh compactData;
+	bool compacted = false;
 	int materialIndex;
 };
 
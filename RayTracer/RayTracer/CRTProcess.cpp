@@ -0,0 +1,126 @@
+#include "CRTProcess.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+#ifdef _WIN32
+std::string CRTProcess::quoteArgument(const std::string& argument)
+{
+	if (!argument.empty() && argument.find_first_of(" \t\n\v\"") == std::string::npos)
+		return argument;
+
+	// Backslashes are literal unless they precede a quote, then they and the quote are escaped
+	std::string quoted = "\"";
+	size_t backslashes = 0;
+	for (char c : argument)
+	{
+		if (c == '\\')
+		{
+			backslashes++;
+			continue;
+		}
+
+		if (c == '"')
+			quoted.append(backslashes * 2 + 1, '\\');
+		else
+			quoted.append(backslashes, '\\');
+
+		quoted += c;
+		backslashes = 0;
+	}
+
+	quoted.append(backslashes * 2, '\\');
+	quoted += '"';
+	return quoted;
+}
+
+int CRTProcess::run(const std::vector<std::string>& arguments)
+{
+	if (arguments.empty())
+		return -1;
+
+	std::string commandLine;
+	for (const std::string& argument : arguments)
+	{
+		if (!commandLine.empty())
+			commandLine += ' ';
+		commandLine += quoteArgument(argument);
+	}
+
+	SECURITY_ATTRIBUTES inheritable = { sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE };
+	HANDLE nul = CreateFileA("NUL", GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &inheritable, OPEN_EXISTING,
+							 FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	STARTUPINFOA startupInfo = {};
+	startupInfo.cb = sizeof(startupInfo);
+	startupInfo.dwFlags = STARTF_USESTDHANDLES;
+	startupInfo.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+	startupInfo.hStdOutput = nul;
+	startupInfo.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+
+	PROCESS_INFORMATION processInfo = {};
+	// CreateProcess may write to the command line buffer
+	std::vector<char> commandBuffer(commandLine.begin(), commandLine.end());
+	commandBuffer.push_back('\0');
+
+	const BOOL started = CreateProcessA(nullptr, commandBuffer.data(), nullptr, nullptr, TRUE, 0, nullptr, nullptr,
+										&startupInfo, &processInfo);
+	if (nul != INVALID_HANDLE_VALUE)
+		CloseHandle(nul);
+	if (!started)
+		return -1;
+
+	WaitForSingleObject(processInfo.hProcess, INFINITE);
+
+	DWORD exitCode = 0;
+	GetExitCodeProcess(processInfo.hProcess, &exitCode);
+	CloseHandle(processInfo.hThread);
+	CloseHandle(processInfo.hProcess);
+
+	return static_cast<int>(exitCode);
+}
+#else
+int CRTProcess::run(const std::vector<std::string>& arguments)
+{
+	if (arguments.empty())
+		return -1;
+
+	std::vector<char*> argv;
+	for (const std::string& argument : arguments)
+	{
+		argv.push_back(const_cast<char*>(argument.c_str()));
+	}
+	argv.push_back(nullptr);
+
+	posix_spawn_file_actions_t fileActions;
+	posix_spawn_file_actions_init(&fileActions);
+	posix_spawn_file_actions_addopen(&fileActions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+	// Like a shell, a program name without a slash is looked up on the PATH
+	pid_t pid;
+	const int error = posix_spawnp(&pid, argv[0], &fileActions, nullptr, argv.data(), environ);
+	posix_spawn_file_actions_destroy(&fileActions);
+	if (error != 0)
+		return -1;
+
+	int status;
+	while (waitpid(pid, &status, 0) < 0)
+	{
+		if (errno != EINTR)
+			return -1;
+	}
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+#endif
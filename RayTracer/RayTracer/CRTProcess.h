@@ -0,0 +1,19 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Child processes started from an argument vector, without a shell in between, so no
+// character of an argument is interpreted
+class CRTProcess
+{
+public:
+	// Runs arguments[0] with all of arguments as its argv and waits for it to exit. Its standard
+	// output is discarded. Returns the exit code, or -1 when the program could not be started.
+	static int run(const std::vector<std::string>& arguments);
+
+private:
+#ifdef _WIN32
+	// Quoted so that CommandLineToArgvW and the C runtime split it back into the same argument
+	static std::string quoteArgument(const std::string& argument);
+#endif
+};
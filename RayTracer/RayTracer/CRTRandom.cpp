@@ -0,0 +1,26 @@
+#include "CRTRandom.h"
+
+CRTRandom::CRTRandom(uint64_t seed, uint64_t stream)
+{
+	// Initialisation sequence of the reference implementation
+	increment = (stream << 1u) | 1u;
+	nextUInt();
+	state += seed;
+	nextUInt();
+}
+
+CRTRandom CRTRandom::forPixel(int x, int y, int sampleIndex, uint32_t seed)
+{
+	uint64_t pixelKey = (static_cast<uint64_t>(static_cast<uint32_t>(y)) << 32) | static_cast<uint32_t>(x);
+	uint64_t sampleKey = (static_cast<uint64_t>(seed) << 32) | static_cast<uint32_t>(sampleIndex);
+
+	return CRTRandom(hash(sampleKey ^ hash(pixelKey)), hash(pixelKey));
+}
+
+uint64_t CRTRandom::hash(uint64_t value)
+{
+	value += 0x9e3779b97f4a7c15ULL;
+	value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+	return value ^ (value >> 31);
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+
+// PCG32 generator (O'Neill, pcg-random.org): 64 bits of state, 32-bit output.
+// Cheap to create, so every pixel sample gets its own stream and the result does not
+// depend on which thread rendered it or in which order.
+class CRTRandom
+{
+public:
+	CRTRandom(uint64_t seed = 0x853c49e6748fea9bULL, uint64_t stream = 0xda3e39cb94b95bdbULL);
+
+	// Stream of pixel (x, y) for one sample index, the same on every run
+	static CRTRandom forPixel(int x, int y, int sampleIndex, uint32_t seed = 0);
+
+	// 64-bit integer mix (SplitMix64 finaliser), for turning keys into seeds
+	static uint64_t hash(uint64_t value);
+
+	uint32_t nextUInt()
+	{
+		uint64_t oldState = state;
+		state = oldState * 6364136223846793005ULL + increment;
+		uint32_t xorShifted = static_cast<uint32_t>(((oldState >> 18u) ^ oldState) >> 27u);
+		uint32_t rotation = static_cast<uint32_t>(oldState >> 59u);
+		return (xorShifted >> rotation) | (xorShifted << ((32u - rotation) & 31u));
+	}
+
+	// Uniform in [0, 1), 24 random bits so the result never rounds up to 1
+	float nextFloat()
+	{
+		return (nextUInt() >> 8) * (1.0f / 16777216.0f);
+	}
+
+private:
+	uint64_t state = 0;
+	uint64_t increment = 0;
+};
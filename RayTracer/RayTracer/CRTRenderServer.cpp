@@ -0,0 +1,282 @@
+#include "CRTRenderServer.h"
+#include <chrono>
+#include <exception>
+#include <iostream>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+
+typedef SOCKET CRTSocket;
+static const CRTSocket INVALID_CRT_SOCKET = INVALID_SOCKET;
+
+static void closeSocket(CRTSocket socket)
+{
+	closesocket(socket);
+}
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef int CRTSocket;
+static const CRTSocket INVALID_CRT_SOCKET = -1;
+
+static void closeSocket(CRTSocket socket)
+{
+	close(socket);
+}
+#endif
+
+// Keeps the socket library initialised for as long as the object lives, a no-op outside Windows
+class CRTSocketLibrary
+{
+public:
+	CRTSocketLibrary()
+	{
+#ifdef _WIN32
+		WSADATA data;
+		WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+	}
+
+	~CRTSocketLibrary()
+	{
+#ifdef _WIN32
+		WSACleanup();
+#endif
+	}
+};
+
+static sockaddr_in getLocalAddress(int port)
+{
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(static_cast<unsigned short>(port));
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	return address;
+}
+
+// Reads up to the next newline, false when the connection is closed first.
+// Bytes after the newline stay in buffer for the next line.
+static bool receiveLine(CRTSocket socket, std::string& buffer, std::string& line)
+{
+	size_t newline;
+	while ((newline = buffer.find('\n')) == std::string::npos)
+	{
+		char chunk[1024];
+		int received = recv(socket, chunk, sizeof(chunk), 0);
+		if (received <= 0)
+			return false;
+
+		buffer.append(chunk, received);
+	}
+
+	line = buffer.substr(0, newline);
+	buffer.erase(0, newline + 1);
+	if (!line.empty() && line.back() == '\r')
+		line.pop_back();
+
+	return true;
+}
+
+static bool sendLine(CRTSocket socket, const std::string& line)
+{
+	const std::string data = line + "\n";
+	size_t sent = 0;
+	while (sent < data.size())
+	{
+		int count = send(socket, data.c_str() + sent, static_cast<int>(data.size() - sent), 0);
+		if (count <= 0)
+			return false;
+
+		sent += count;
+	}
+
+	return true;
+}
+
+CRTRenderServer::CRTRenderServer(CRTScene& scene, const Renderer& renderer)
+	: scene(scene), renderer(renderer)
+{
+}
+
+bool CRTRenderServer::run(int port)
+{
+	CRTSocketLibrary socketLibrary;
+
+	CRTSocket listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (listener == INVALID_CRT_SOCKET)
+	{
+		std::cout << "Failed to create the server socket" << std::endl;
+		return false;
+	}
+
+	int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+	sockaddr_in address = getLocalAddress(port);
+	if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 4) != 0)
+	{
+		std::cout << "Failed to listen on port " << port << std::endl;
+		closeSocket(listener);
+		return false;
+	}
+
+	std::cout << "Serving " << scene.getSettings().imageWidth << "x" << scene.getSettings().imageHeight
+			  << " scene on 127.0.0.1:" << port << std::endl;
+
+	// One client at a time, the renderer already uses every core for a request
+	bool quit = false;
+	while (!quit)
+	{
+		CRTSocket client = accept(listener, nullptr, nullptr);
+		if (client == INVALID_CRT_SOCKET)
+			continue;
+
+		std::string buffer;
+		std::string request;
+		while (!quit && receiveLine(client, buffer, request))
+		{
+			// A failed request is answered with an error, the server keeps serving
+			std::string reply;
+			try
+			{
+				reply = handleRequest(request, quit);
+			}
+			catch (const std::exception& e)
+			{
+				std::cout << "Request failed: " << e.what() << std::endl;
+				reply = std::string("error ") + e.what();
+			}
+
+			if (!sendLine(client, reply))
+				break;
+		}
+
+		closeSocket(client);
+	}
+
+	closeSocket(listener);
+	return true;
+}
+
+bool CRTRenderServer::sendRequest(int port, const std::string& request, std::string& reply)
+{
+	CRTSocketLibrary socketLibrary;
+
+	CRTSocket connection = socket(AF_INET, SOCK_STREAM, 0);
+	if (connection == INVALID_CRT_SOCKET)
+		return false;
+
+	sockaddr_in address = getLocalAddress(port);
+	std::string buffer;
+	const bool succeeded = connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 &&
+						   sendLine(connection, request) && receiveLine(connection, buffer, reply);
+
+	closeSocket(connection);
+	return succeeded;
+}
+
+std::string CRTRenderServer::handleRequest(const std::string& request, bool& quit)
+{
+	std::istringstream iss(request);
+	std::string command;
+	iss >> command;
+
+	if (command == "quit")
+	{
+		quit = true;
+		return "ok";
+	}
+
+	if (command == "render")
+		return handleRender(iss);
+
+	return "error unknown request " + command;
+}
+
+std::string CRTRenderServer::handleRender(std::istringstream& request)
+{
+	auto requestStart = std::chrono::steady_clock::now();
+
+	std::string outputFile;
+	if (!(request >> outputFile))
+		return "error missing output file";
+
+	const CRTSettings sceneSettings = scene.getSettings();
+	const CRTCamera sceneCamera = scene.getCamera();
+
+	CRTSettings settings = sceneSettings;
+	CRTCamera camera = sceneCamera;
+
+	std::string option;
+	while (request >> option)
+	{
+		bool valid = true;
+		if (option == "size")
+		{
+			valid = static_cast<bool>(request >> settings.imageWidth >> settings.imageHeight) &&
+					settings.imageWidth > 0 && settings.imageHeight > 0;
+		}
+		else if (option == "position")
+		{
+			float x, y, z;
+			valid = static_cast<bool>(request >> x >> y >> z);
+			camera.setPosition(CRTVector(x, y, z));
+		}
+		else if (option == "pan" || option == "tilt" || option == "roll")
+		{
+			float degrees;
+			valid = static_cast<bool>(request >> degrees);
+			if (option == "pan")
+				camera.pan(degrees);
+			else if (option == "tilt")
+				camera.tilt(degrees);
+			else
+				camera.roll(degrees);
+		}
+		else if (option == "orbit")
+		{
+			float degrees, x, y, z;
+			valid = static_cast<bool>(request >> degrees >> x >> y >> z);
+			camera.panAroundTarget(degrees, CRTVector(x, y, z));
+		}
+		else
+		{
+			return "error unknown option " + option;
+		}
+
+		if (!valid)
+			return "error bad value for " + option;
+	}
+
+	// The overrides only last for this request
+	scene.setSettings(settings);
+	scene.setCamera(camera);
+
+	auto renderStart = std::chrono::steady_clock::now();
+	try
+	{
+		renderer.renderScene(outputFile);
+	}
+	catch (...)
+	{
+		scene.setSettings(sceneSettings);
+		scene.setCamera(sceneCamera);
+		throw;
+	}
+	auto renderEnd = std::chrono::steady_clock::now();
+
+	scene.setSettings(sceneSettings);
+	scene.setCamera(sceneCamera);
+
+	const double renderSeconds = std::chrono::duration<double>(renderEnd - renderStart).count();
+	const double requestSeconds = std::chrono::duration<double>(renderEnd - requestStart).count();
+
+	std::cout << "Request " << ++requestCount << ": " << outputFile << " in " << requestSeconds << " s" << std::endl;
+
+	return "ok " + std::to_string(renderSeconds) + " " + std::to_string(requestSeconds);
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <sstream>
+#include <string>
+#include "CRTScene.h"
+#include "Renderer.h"
+
+// Long-running render process that keeps the scene, its textures and the prepared meshes loaded
+// and renders one request after another. Clients connect to 127.0.0.1:<port> and send one request
+// per line; every request gets one reply line.
+//
+//   render <output file> [size <width> <height>] [position <x> <y> <z>]
+//          [pan <degrees>] [tilt <degrees>] [roll <degrees>] [orbit <degrees> <x> <y> <z>]
+//   quit
+//
+// Camera options start from the camera of the scene file and apply in the order given; orbit is
+// CRTCamera::panAroundTarget. The reply is "ok <render seconds> <request seconds>" or "error <reason>".
+class CRTRenderServer
+{
+public:
+	CRTRenderServer(CRTScene& scene, const Renderer& renderer);
+
+	// Serves until a quit request, false when the port cannot be opened
+	bool run(int port);
+
+	// Client side: sends one request line and waits for its reply
+	static bool sendRequest(int port, const std::string& request, std::string& reply);
+
+private:
+	CRTScene& scene;
+	const Renderer& renderer;
+	int requestCount = 0;
+
+	// Returns the reply line, quit is set for a quit request. Throws when rendering fails, the
+	// scene is restored first.
+	std::string handleRequest(const std::string& request, bool& quit);
+	std::string handleRender(std::istringstream& request);
+};
@@ -0,0 +1,151 @@
+#include "CRTRenderStats.h"
+#include <algorithm>
+#include <fstream>
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/ostreamwrapper.h"
+
+static thread_local CRTRenderStats* threadStats = nullptr;
+
+static const char* rayTypeNames[CRTRenderStats::RAY_TYPE_COUNT] = {
+	"invalid", "camera", "shadow", "reflection", "refractive"
+};
+
+long long CRTRenderStats::getTotalRays() const
+{
+	long long total = 0;
+	for (int i = 0; i < RAY_TYPE_COUNT; i++)
+	{
+		total += raysByType[i];
+	}
+
+	return total;
+}
+
+void CRTRenderStats::merge(const CRTRenderStats& other)
+{
+	for (int i = 0; i < RAY_TYPE_COUNT; i++)
+	{
+		raysByType[i] += other.raysByType[i];
+	}
+
+	triangleTests += other.triangleTests;
+	boxTests += other.boxTests;
+	hits += other.hits;
+	shadowOcclusions += other.shadowOcclusions;
+	textureSamples += other.textureSamples;
+	rouletteTerminations += other.rouletteTerminations;
+	shadowCacheLookups += other.shadowCacheLookups;
+	shadowCacheHits += other.shadowCacheHits;
+	arenaAllocations += other.arenaAllocations;
+	arenaBytes += other.arenaBytes;
+	arenaBlocks += other.arenaBlocks;
+	tileHeapAllocations += other.tileHeapAllocations;
+	maxDepth = std::max(maxDepth, other.maxDepth);
+
+	parseSeconds += other.parseSeconds;
+	buildSeconds += other.buildSeconds;
+	traceSeconds += other.traceSeconds;
+	outputSeconds += other.outputSeconds;
+}
+
+void CRTRenderStats::print(std::ostream& os) const
+{
+	os << "Render statistics:\n";
+	os << "  rays: " << getTotalRays() << "\n";
+	for (int i = 1; i < RAY_TYPE_COUNT; i++)
+	{
+		os << "    " << rayTypeNames[i] << ": " << raysByType[i] << "\n";
+	}
+	os << "  triangle tests: " << triangleTests << "\n";
+	os << "  box tests: " << boxTests << "\n";
+	os << "  hits: " << hits << "\n";
+	os << "  shadow occlusions: " << shadowOcclusions << "\n";
+	os << "  texture samples: " << textureSamples << "\n";
+	os << "  roulette terminations: " << rouletteTerminations << "\n";
+	os << "  shadow cache: " << shadowCacheHits << " hits / " << shadowCacheLookups << " lookups";
+	if (shadowCacheLookups > 0)
+		os << " (" << 100.0 * shadowCacheHits / shadowCacheLookups << "%)";
+	os << "\n";
+	os << "  arena: " << arenaAllocations << " allocations, " << arenaBytes << " bytes, "
+	   << arenaBlocks << " blocks\n";
+#ifdef CRT_ENABLE_ALLOCATION_TRACKING
+	os << "  tile heap allocations: " << tileHeapAllocations << "\n";
+#endif
+	os << "  max depth: " << maxDepth << "\n";
+	os << "  parse: " << parseSeconds << " s\n";
+	os << "  build: " << buildSeconds << " s\n";
+	os << "  trace: " << traceSeconds << " s\n";
+	os << "  output: " << outputSeconds << " s\n";
+}
+
+void CRTRenderStats::writeJson(const std::string& fileName) const
+{
+	std::ofstream ofs(fileName);
+	rapidjson::OStreamWrapper osw(ofs);
+	rapidjson::PrettyWriter<rapidjson::OStreamWrapper> writer(osw);
+
+	writer.StartObject();
+
+	writer.Key("rays");
+	writer.StartObject();
+	for (int i = 1; i < RAY_TYPE_COUNT; i++)
+	{
+		writer.Key(rayTypeNames[i]);
+		writer.Int64(raysByType[i]);
+	}
+	writer.EndObject();
+
+	writer.Key("triangle_tests");
+	writer.Int64(triangleTests);
+	writer.Key("box_tests");
+	writer.Int64(boxTests);
+	writer.Key("hits");
+	writer.Int64(hits);
+	writer.Key("shadow_occlusions");
+	writer.Int64(shadowOcclusions);
+	writer.Key("texture_samples");
+	writer.Int64(textureSamples);
+	writer.Key("roulette_terminations");
+	writer.Int64(rouletteTerminations);
+	writer.Key("shadow_cache_lookups");
+	writer.Int64(shadowCacheLookups);
+	writer.Key("shadow_cache_hits");
+	writer.Int64(shadowCacheHits);
+	writer.Key("arena_allocations");
+	writer.Int64(arenaAllocations);
+	writer.Key("arena_bytes");
+	writer.Int64(arenaBytes);
+	writer.Key("arena_blocks");
+	writer.Int64(arenaBlocks);
+#ifdef CRT_ENABLE_ALLOCATION_TRACKING
+	writer.Key("tile_heap_allocations");
+	writer.Int64(tileHeapAllocations);
+#endif
+	writer.Key("max_depth");
+	writer.Int(maxDepth);
+
+	writer.Key("seconds");
+	writer.StartObject();
+	writer.Key("parse");
+	writer.Double(parseSeconds);
+	writer.Key("build");
+	writer.Double(buildSeconds);
+	writer.Key("trace");
+	writer.Double(traceSeconds);
+	writer.Key("output");
+	writer.Double(outputSeconds);
+	writer.EndObject();
+
+	writer.EndObject();
+	ofs << std::endl;
+}
+
+CRTRenderStats* CRTRenderStats::getThreadStats()
+{
+	return threadStats;
+}
+
+void CRTRenderStats::setThreadStats(CRTRenderStats* stats)
+{
+	threadStats = stats;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include "Math/CRTRay.h"
+
+// Counters and phase timings of one render. Each render thread collects into its own
+// instance, set with setThreadStats(); the renderer merges them at the end of the frame.
+// While no instance is set, every hook in the renderer is a single null pointer check.
+struct CRTRenderStats
+{
+	static constexpr int RAY_TYPE_COUNT = static_cast<int>(CRTRayType::REFRACTIVE) + 1;
+
+	long long raysByType[RAY_TYPE_COUNT] = {};
+	long long triangleTests = 0;
+	long long boxTests = 0;
+	long long hits = 0;
+	long long shadowOcclusions = 0;
+	long long textureSamples = 0;
+	long long rouletteTerminations = 0;
+	// Shadow rays checked against the cached occluder of their light, and how many it blocked
+	long long shadowCacheLookups = 0;
+	long long shadowCacheHits = 0;
+	// Transient allocations served by the render threads' arenas and the heap blocks they took for them
+	long long arenaAllocations = 0;
+	long long arenaBytes = 0;
+	long long arenaBlocks = 0;
+	// Heap allocations while rendering tiles, only counted with CRT_ENABLE_ALLOCATION_TRACKING
+	long long tileHeapAllocations = 0;
+	int maxDepth = 0;
+
+	double parseSeconds = 0.0;
+	double buildSeconds = 0.0;
+	double traceSeconds = 0.0;
+	double outputSeconds = 0.0;
+
+	long long getTotalRays() const;
+
+	void merge(const CRTRenderStats& other);
+
+	void print(std::ostream& os) const;
+	void writeJson(const std::string& fileName) const;
+
+	static CRTRenderStats* getThreadStats();
+	static void setThreadStats(CRTRenderStats* stats);
+};
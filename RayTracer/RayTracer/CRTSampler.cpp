@@ -0,0 +1,147 @@
+#include "CRTSampler.h"
+#include <cmath>
+
+static const int primes[CRTSampler::HALTON_DIMENSIONS] = {
+	2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53
+};
+
+static const char* typeNames[] = { "random", "halton", "sobol" };
+
+static const float ONE_MINUS_EPSILON = 0x1.fffffep-1f;
+
+// Dimension 1 of the Sobol sequence for every value of each byte of the index
+struct SobolTable
+{
+	uint32_t bytes[4][256];
+
+	SobolTable()
+	{
+		// Direction numbers of the primitive polynomial x + 1, one per index bit
+		uint32_t directions[32];
+		uint32_t v = 1u << 31;
+		for (int bit = 0; bit < 32; bit++, v ^= v >> 1)
+		{
+			directions[bit] = v;
+		}
+
+		for (int byte = 0; byte < 4; byte++)
+		{
+			for (int value = 0; value < 256; value++)
+			{
+				uint32_t result = 0;
+				for (int bit = 0; bit < 8; bit++)
+				{
+					if (value & (1 << bit))
+						result ^= directions[byte * 8 + bit];
+				}
+				bytes[byte][value] = result;
+			}
+		}
+	}
+};
+
+CRTSampler::CRTSampler(CRTSamplerType type, int x, int y, uint32_t seed)
+	: type(type), x(x), y(y), seed(seed)
+{
+}
+
+void CRTSampler::startSample(int sampleIndex)
+{
+	this->sampleIndex = sampleIndex;
+	dimension = 0;
+	random = CRTRandom::forPixel(x, y, sampleIndex, seed);
+}
+
+float CRTSampler::get1D()
+{
+	const int dim = dimension++;
+	const uint32_t index = static_cast<uint32_t>(sampleIndex);
+
+	if (type == CRTSamplerType::SOBOL)
+	{
+		// Later pairs of dimensions reuse the first two at indices XORed with a constant of the pair. That maps
+		// the first 2^k indices onto another aligned block of 2^k, so every power of two prefix stays stratified.
+		const uint32_t pairIndex = dim < 2 ? index : index ^ static_cast<uint32_t>(getScramble(dim & ~1) >> 32);
+		uint32_t bits = sobol(dim & 1, pairIndex) ^ static_cast<uint32_t>(getScramble(dim));
+		return (bits >> 8) * (1.0f / 16777216.0f);
+	}
+
+	if (type == CRTSamplerType::HALTON && dim < HALTON_DIMENSIONS)
+	{
+		float shift = (getScramble(dim) >> 40) * (1.0f / 16777216.0f);
+		float value = radicalInverse(primes[dim], index) + shift;
+		if (value >= 1.0f)
+			value -= 1.0f;
+		return std::fmin(value, ONE_MINUS_EPSILON);
+	}
+
+	return random.nextFloat();
+}
+
+void CRTSampler::get2D(float& u, float& v)
+{
+	u = get1D();
+	v = get1D();
+}
+
+float CRTSampler::radicalInverse(int base, uint32_t index)
+{
+	const double inverseBase = 1.0 / base;
+	double factor = inverseBase;
+	double result = 0.0;
+
+	while (index > 0)
+	{
+		result += (index % base) * factor;
+		index /= base;
+		factor *= inverseBase;
+	}
+
+	return std::fmin(static_cast<float>(result), ONE_MINUS_EPSILON);
+}
+
+uint32_t CRTSampler::sobol(int dimension, uint32_t index)
+{
+	// Dimension 0 is the van der Corput sequence, reversed bits of the index
+	if (dimension == 0)
+	{
+		index = (index << 16) | (index >> 16);
+		index = ((index & 0x00ff00ffu) << 8) | ((index & 0xff00ff00u) >> 8);
+		index = ((index & 0x0f0f0f0fu) << 4) | ((index & 0xf0f0f0f0u) >> 4);
+		index = ((index & 0x33333333u) << 2) | ((index & 0xccccccccu) >> 2);
+		index = ((index & 0x55555555u) << 1) | ((index & 0xaaaaaaaau) >> 1);
+		return index;
+	}
+
+	// Dimension 1 is the XOR of the direction numbers of the set index bits, looked up a byte at a time
+	static const SobolTable table;
+	return table.bytes[0][index & 0xffu] ^ table.bytes[1][(index >> 8) & 0xffu] ^
+		   table.bytes[2][(index >> 16) & 0xffu] ^ table.bytes[3][index >> 24];
+}
+
+const char* CRTSampler::getName(CRTSamplerType type)
+{
+	return typeNames[static_cast<int>(type)];
+}
+
+bool CRTSampler::getType(const std::string& name, CRTSamplerType& type)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		if (name == typeNames[i])
+		{
+			type = static_cast<CRTSamplerType>(i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+uint64_t CRTSampler::getScramble(int dimension) const
+{
+	uint64_t pixelKey = (static_cast<uint64_t>(static_cast<uint32_t>(y)) << 32) | static_cast<uint32_t>(x);
+	uint64_t dimensionKey = (static_cast<uint64_t>(seed) << 32) | static_cast<uint32_t>(dimension);
+
+	return CRTRandom::hash(pixelKey ^ CRTRandom::hash(dimensionKey));
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "CRTRandom.h"
+
+enum class CRTSamplerType
+{
+	RANDOM,
+	HALTON,
+	SOBOL
+};
+
+// Sample values of one pixel. startSample() selects the sample, get1D() and get2D() then
+// hand out its dimensions in order. Everything is a function of (pixel, sample index,
+// dimension, seed), so renders are reproducible with any number of threads.
+//
+// The low-discrepancy sequences are shared by all pixels and decorrelated per pixel:
+// Halton by a random shift per dimension (Cranley-Patterson rotation), Sobol by random
+// digit scrambling, which keeps consecutive pairs of dimensions a (0, 2)-sequence. Sobol pairs
+// past the first are decorrelated from it by a per-pixel shuffle of the sample index.
+class CRTSampler
+{
+public:
+	CRTSampler(CRTSamplerType type, int x, int y, uint32_t seed = 0);
+
+	void startSample(int sampleIndex);
+
+	float get1D();
+	void get2D(float& u, float& v);
+
+	// Halton sequence along one dimension
+	static float radicalInverse(int base, uint32_t index);
+	// The first two dimensions of the Sobol sequence, as 32-bit fractions
+	static uint32_t sobol(int dimension, uint32_t index);
+
+	static const char* getName(CRTSamplerType type);
+	static bool getType(const std::string& name, CRTSamplerType& type);
+
+	// Halton dimensions past this many are random
+	static const int HALTON_DIMENSIONS = 16;
+private:
+	CRTSamplerType type;
+	int x;
+	int y;
+	uint32_t seed;
+	int sampleIndex = 0;
+	int dimension = 0;
+	CRTRandom random;
+
+	uint64_t getScramble(int dimension) const;
+};
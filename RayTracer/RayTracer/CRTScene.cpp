@@ -1,29 +1,55 @@
 #include "CRTScene.h"
+#include <chrono>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <assert.h>
 #include "CRTSceneParser.h"
+#include "CRTTimeline.h"
 
 CRTScene::CRTScene(const std::string& sceneFileName)
 {
 	parseSceneFile(sceneFileName);
 }
 
+CRTScene::~CRTScene()
+{
+	for (CRTTexture* texture : textures)
+	{
+		delete texture;
+	}
+}
+
 void CRTScene::parseSceneFile(const std::string& sceneFileName)
 {
 	CRTSceneParser::parseScene(sceneFileName, *this);
 }
 
+CRTSceneChanges CRTScene::reload(const std::string& sceneFileName)
+{
+	return CRTSceneParser::parseScene(sceneFileName, *this);
+}
+
 const CRTSettings& CRTScene::getSettings() const
 {
 	return settings;
 }
 
+void CRTScene::setSettings(const CRTSettings& settings)
+{
+	this->settings = settings;
+}
+
 const CRTCamera& CRTScene::getCamera() const
 {
 	return camera;
 }
 
+void CRTScene::setCamera(const CRTCamera& camera)
+{
+	this->camera = camera;
+}
+
 const std::vector<CRTMesh>& CRTScene::getObjects() const
 {
 	return geometryObjects;
@@ -34,6 +60,11 @@ const std::vector<CRTLight>& CRTScene::getLights() const
 	return lights;
 }
 
+const CRTLightTree& CRTScene::getLightTree() const
+{
+	return lightTree;
+}
+
 const std::vector<CRTMaterial>& CRTScene::getMaterials() const
 {
 	return materials;
@@ -57,4 +88,114 @@ const CRTTexture* CRTScene::getTextureByName(const std::string& name) const
 	return nullptr;
 }
 
+int CRTScene::compactMeshes(bool quantizePositions)
+{
+	int compactedCount = 0;
+	for (CRTMesh& mesh : geometryObjects)
+	{
+		if (!mesh.isCompact())
+		{
+			mesh.compact(quantizePositions);
+			compactedCount++;
+		}
+	}
+
+	return compactedCount;
+}
+
+size_t CRTScene::getMeshBytes() const
+{
+	size_t bytes = 0;
+	for (const CRTMesh& mesh : geometryObjects)
+	{
+		bytes += mesh.getVertexDataBytes();
+	}
+
+	return bytes;
+}
+
+void CRTScene::buildBVHs(CRTBVHLayout layout, const std::string& cacheDirectory)
+{
+	if (!cacheDirectory.empty())
+	{
+		std::error_code error;
+		std::filesystem::create_directories(cacheDirectory, error);
+	}
+
+	auto buildStart = std::chrono::steady_clock::now();
+
+	for (size_t meshIdx = 0; meshIdx < geometryObjects.size(); meshIdx++)
+	{
+		CRT_TIMELINE_ZONE_INDEX("build bvh", static_cast<int>(meshIdx));
+		geometryObjects[meshIdx].buildBVH(layout, cacheDirectory);
+	}
+
+	buildSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count();
+}
+
+size_t CRTScene::getBVHBytes() const
+{
+	size_t bytes = 0;
+	for (const CRTMesh& mesh : geometryObjects)
+	{
+		bytes += mesh.getBVH().getMemoryBytes();
+	}
+
+	return bytes;
+}
+
+double CRTScene::getParseSeconds() const
+{
+	return parseSeconds;
+}
+
+double CRTScene::getBuildSeconds() const
+{
+	return buildSeconds;
+}
+
+bool CRTSceneChanges::isEmpty() const
+{
+	return !settings && !camera && !lights && !materials && meshesRebuilt == 0 && meshesRemoved == 0 &&
+		texturesLoaded == 0 && texturesRemoved == 0;
+}
+
+void CRTSceneChanges::print(std::ostream& os) const
+{
+	if (isEmpty())
+	{
+		os << "no changes";
+		return;
+	}
 
+	const char* separator = "";
+	if (settings)
+	{
+		os << separator << "settings";
+		separator = ", ";
+	}
+	if (camera)
+	{
+		os << separator << "camera";
+		separator = ", ";
+	}
+	if (lights)
+	{
+		os << separator << "lights";
+		separator = ", ";
+	}
+	if (materials)
+	{
+		os << separator << "materials";
+		separator = ", ";
+	}
+	if (meshesRebuilt > 0 || meshesRemoved > 0)
+	{
+		os << separator << meshesRebuilt << " meshes rebuilt, " << meshesRemoved << " removed";
+		separator = ", ";
+	}
+	if (texturesLoaded > 0 || texturesRemoved > 0)
+	{
+		os << separator << texturesLoaded << " textures loaded, " << texturesRemoved << " removed";
+	}
+}
@@ -1,8 +1,12 @@
 #pragma once
+#include <cstdint>
+#include <ostream>
 #include <string>
+#include <vector>
 #include "CRTMesh.h"
 #include "CRTCamera.h"
 #include "CRTLight.h"
+#include "CRTLightTree.h"
 #include "CRTMaterial.h"
 #include "CRTTexture.h"
 
@@ -11,6 +15,27 @@ struct CRTSettings
 	CRTVector backgroundColor;
 	int imageWidth;
 	int imageHeight;
+	// Rays deeper than this are not traced
+	int maxRayDepth = 5;
+	// Rays from this depth on are terminated with Russian roulette on their throughput, 0 disables it
+	int russianRouletteDepth = 0;
+};
+
+// What parsing the scene file changed in the loaded scene. Materials, lights, settings and camera
+// are cheap and always parsed again; meshes and textures are prepared again only when they changed.
+struct CRTSceneChanges
+{
+	bool settings = false;
+	bool camera = false;
+	bool lights = false;
+	bool materials = false;
+	int meshesRebuilt = 0;
+	int meshesRemoved = 0;
+	int texturesLoaded = 0;
+	int texturesRemoved = 0;
+
+	bool isEmpty() const;
+	void print(std::ostream& os) const;
 };
 
 class CRTScene
@@ -19,24 +44,65 @@ public:
 	friend class CRTSceneParser;
 
 	CRTScene(const std::string& sceneFileName);
+	CRTScene(const CRTScene& other) = delete;
+	CRTScene& operator=(const CRTScene& other) = delete;
+	~CRTScene();
 
 	void parseSceneFile(const std::string& sceneFileName);
+
+	// Parses the scene file again and keeps the meshes, their prepared triangle streams and the
+	// textures whose part of the file did not change. Parse and build seconds then cover only this reload.
+	CRTSceneChanges reload(const std::string& sceneFileName);
 	const CRTSettings& getSettings() const;
+	void setSettings(const CRTSettings& settings);
 	const CRTCamera& getCamera() const;
+	void setCamera(const CRTCamera& camera);
 	const std::vector<CRTMesh>& getObjects() const;
 	const std::vector<CRTLight>& getLights() const;
+	const CRTLightTree& getLightTree() const;
 	const std::vector<CRTMaterial>& getMaterials() const;
 	const std::vector<CRTTexture*>& getTextures() const;
 
 	const CRTTexture* getTextureByName(const std::string& name) const;
 
+	// Switches every mesh to its compact encoding, see CRTMesh::compact. Meshes a reload rebuilds
+	// come back uncompressed, so call it again after reload(). Returns how many meshes it compacted.
+	int compactMeshes(bool quantizePositions);
+	size_t getMeshBytes() const;
+
+	// Builds the BVH of every mesh, see CRTMesh::buildBVH. Like compactMeshes(), call it again after reload().
+	// A non-empty cache directory is created when missing.
+	void buildBVHs(CRTBVHLayout layout, const std::string& cacheDirectory = std::string());
+	size_t getBVHBytes() const;
+
+	// Time spent reading the scene file and preparing the meshes for rendering, building the BVHs included
+	double getParseSeconds() const;
+	double getBuildSeconds() const;
+
 private:
 	std::vector<CRTMesh> geometryObjects;
 	CRTCamera camera;
 	CRTSettings settings;
 	std::vector<CRTLight> lights;
+	CRTLightTree lightTree;
 	std::vector<CRTMaterial> materials;
 	std::vector<CRTTexture*> textures;
-	
+
+	double parseSeconds = 0.0;
+	double buildSeconds = 0.0;
+
+	// Hashes of the parts of the scene file the loaded scene was made from
+	struct SourceHashes
+	{
+		bool valid = false;
+		uint64_t settings = 0;
+		uint64_t camera = 0;
+		uint64_t lights = 0;
+		uint64_t materials = 0;
+		std::vector<uint64_t> objects;
+		std::vector<uint64_t> textures;
+	};
+
+	SourceHashes sourceHashes;
 };
 
@@ -4,11 +4,93 @@
 #include "CRTTextureBitmap.h"
 #include "CRTTextureChecker.h"
 #include "CRTTextureEdges.h"
+#include "CRTTimeline.h"
+#include "CRTRandom.h"
 
 #include <iostream>
 #include <fstream>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
 using namespace rapidjson;
 
+// Member of an object, or a null value when the object does not have it, so that optional
+// keys can be checked with IsNull()
+static const Value& getMember(const Value& val, const char* name)
+{
+	static const Value nullValue;
+
+	Value::ConstMemberIterator member = val.FindMember(name);
+	return member != val.MemberEnd() ? member->value : nullValue;
+}
+
+// Element count of an array value, 0 for anything else
+static size_t getArraySize(const Value& val)
+{
+	return val.IsArray() ? val.GetArray().Size() : 0;
+}
+
+// Hash of a JSON value and everything in it, a reload compares them to find what changed
+static uint64_t hashValue(const Value& val, uint64_t hash = 0)
+{
+	hash = CRTRandom::hash(hash ^ static_cast<uint64_t>(val.GetType()));
+
+	if (val.IsNumber())
+	{
+		double number = val.GetDouble();
+		uint64_t bits;
+		std::memcpy(&bits, &number, sizeof(bits));
+		hash = CRTRandom::hash(hash ^ bits);
+	}
+	else if (val.IsString())
+	{
+		for (SizeType i = 0; i < val.GetStringLength(); i++)
+		{
+			hash = hash * 31 + static_cast<unsigned char>(val.GetString()[i]);
+		}
+		hash = CRTRandom::hash(hash);
+	}
+	else if (val.IsArray())
+	{
+		for (const Value& element : val.GetArray())
+		{
+			hash = hashValue(element, hash);
+		}
+	}
+	else if (val.IsObject())
+	{
+		for (const auto& member : val.GetObject())
+		{
+			hash = hashValue(member.name, hash);
+			hash = hashValue(member.value, hash);
+		}
+	}
+
+	return hash;
+}
+
+// Hash of a top-level section, 0 when the file does not have it
+static uint64_t hashSection(const Document& doc, const char* name)
+{
+	return doc.HasMember(name) ? hashValue(doc[name]) : 0;
+}
+
+// The material index is left out, assigning another material needs no rebuild
+static uint64_t hashMeshGeometry(const Value& val)
+{
+	uint64_t hash = 0;
+	for (const auto& member : val.GetObject())
+	{
+		if (std::strcmp(member.name.GetString(), "material_index") != 0)
+		{
+			hash = hashValue(member.name, hash);
+			hash = hashValue(member.value, hash);
+		}
+	}
+
+	return hash;
+}
+
 CRTMatrix CRTSceneParser::loadMatrix(const rapidjson::Value::ConstArray& arr)
 {
 	assert(arr.Size() == 9);
@@ -36,41 +118,64 @@ CRTVector CRTSceneParser::loadVector(const Value::ConstArray& arr, int startInde
 	return vec;
 }
 
-void CRTSceneParser::parseSettings(const Document& doc, CRTScene& scene)
+void CRTSceneParser::loadSettings(const Document& doc, CRTSettings& settings)
 {
-	const Value& settingsVal = doc.FindMember("settings")->value;
+	const Value& settingsVal = getMember(doc, "settings");
 	if (!settingsVal.IsNull() && settingsVal.IsObject())
 	{
-		const Value& backgroundColorVal = settingsVal.FindMember("background_color")->value;
+		const Value& backgroundColorVal = getMember(settingsVal, "background_color");
 		assert(!backgroundColorVal.IsNull() && backgroundColorVal.IsArray());
-		scene.settings.backgroundColor = loadVector(backgroundColorVal.GetArray(), 0);
+		settings.backgroundColor = loadVector(backgroundColorVal.GetArray(), 0);
 
-		const Value& imgSettings = settingsVal.FindMember("image_settings")->value;
+		const Value& imgSettings = getMember(settingsVal, "image_settings");
 		assert(!imgSettings.IsNull());
 
-		const Value& width = imgSettings.FindMember("width")->value;
+		const Value& width = getMember(imgSettings, "width");
 		assert(!width.IsNull());
-		scene.settings.imageWidth = width.GetInt();
+		settings.imageWidth = width.GetInt();
 
-		const Value& height = imgSettings.FindMember("height")->value;
+		const Value& height = getMember(imgSettings, "height");
 		assert(!height.IsNull());
-		scene.settings.imageHeight = height.GetInt();
+		settings.imageHeight = height.GetInt();
+
+		if (settingsVal.HasMember("max_ray_depth"))
+		{
+			settings.maxRayDepth = settingsVal["max_ray_depth"].GetInt();
+		}
+
+		if (settingsVal.HasMember("russian_roulette_depth"))
+		{
+			settings.russianRouletteDepth = settingsVal["russian_roulette_depth"].GetInt();
+		}
 	}
 
-	//std::cout << scene.settings.imageWidth << ' ' << scene.settings.imageHeight << std::endl;
-	//scene.settings.backgroundColor.print(std::cout);
+	//std::cout << settings.imageWidth << ' ' << settings.imageHeight << std::endl;
+	//settings.backgroundColor.print(std::cout);
+}
+
+void CRTSceneParser::parseSettings(const Document& doc, CRTScene& scene, CRTSceneChanges& changes)
+{
+	const uint64_t hash = hashSection(doc, "settings");
+	changes.settings = !scene.sourceHashes.valid || hash != scene.sourceHashes.settings;
+	scene.sourceHashes.settings = hash;
+
+	loadSettings(doc, scene.settings);
 }
 
-void CRTSceneParser::parseCamera(const rapidjson::Document& doc, CRTScene& scene)
+void CRTSceneParser::parseCamera(const rapidjson::Document& doc, CRTScene& scene, CRTSceneChanges& changes)
 {
-	const Value& cameraVal = doc.FindMember("camera")->value;
+	const uint64_t hash = hashSection(doc, "camera");
+	changes.camera = !scene.sourceHashes.valid || hash != scene.sourceHashes.camera;
+	scene.sourceHashes.camera = hash;
+
+	const Value& cameraVal = getMember(doc, "camera");
 	if (!cameraVal.IsNull() && cameraVal.IsObject())
 	{
-		const Value& matrixVal = cameraVal.FindMember("matrix")->value;
+		const Value& matrixVal = getMember(cameraVal, "matrix");
 		assert(!matrixVal.IsNull() && matrixVal.IsArray());
 		scene.camera.setRotationMatrix(loadMatrix(matrixVal.GetArray()));
 
-		const Value& positionVal = cameraVal.FindMember("position")->value;
+		const Value& positionVal = getMember(cameraVal, "position");
 		assert(!positionVal.IsNull() && positionVal.IsArray());
 		scene.camera.setPosition(loadVector(positionVal.GetArray(), 0));
 	}
@@ -78,11 +183,16 @@ void CRTSceneParser::parseCamera(const rapidjson::Document& doc, CRTScene& scene
 	//scene.camera.getRotationMatrix().print();
 }
 
-void CRTSceneParser::parseMesh(const rapidjson::Value& val, CRTScene& scene)
+// meshIdx only labels the timeline zone, which is compiled out without CRT_ENABLE_TIMELINE
+CRTMesh CRTSceneParser::parseMesh(const rapidjson::Value& val, CRTScene& scene, [[maybe_unused]] int meshIdx)
 {
 	CRTMesh mesh;
 
-	const Value& uvsVal = val.FindMember("uvs")->value;
+	const Value& uvsVal = getMember(val, "uvs");
+	const Value& verticesVal = getMember(val, "vertices");
+	const Value& indicesVal = getMember(val, "triangles");
+	mesh.reserve(getArraySize(verticesVal) / 3, getArraySize(indicesVal), getArraySize(uvsVal) / 3);
+
 	if (!uvsVal.IsNull() && uvsVal.IsArray())
 	{
 		int uvsCount = uvsVal.GetArray().Size();
@@ -94,7 +204,6 @@ void CRTSceneParser::parseMesh(const rapidjson::Value& val, CRTScene& scene)
 		}
 	}
 
-	const Value& verticesVal = val.FindMember("vertices")->value;
 	if (!verticesVal.IsNull() && verticesVal.IsArray())
 	{
 		int verticesCount = verticesVal.GetArray().Size();
@@ -106,7 +215,6 @@ void CRTSceneParser::parseMesh(const rapidjson::Value& val, CRTScene& scene)
 		}
 	}
 
-	const Value& indicesVal = val.FindMember("triangles")->value;
 	if (!indicesVal.IsNull() && indicesVal.IsArray())
 	{
 		int indicesCount = indicesVal.GetArray().Size();
@@ -118,42 +226,100 @@ void CRTSceneParser::parseMesh(const rapidjson::Value& val, CRTScene& scene)
 		}
 	}
 
+	mesh.setMaterialIndex(parseMaterialIndex(val));
+
+	{
+		CRT_TIMELINE_ZONE_INDEX("build mesh", meshIdx);
+
+		auto buildStart = std::chrono::steady_clock::now();
+		mesh.calculateVertexNormals();
+		mesh.buildTriangleStream();
+		scene.buildSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count();
+	}
+
+	return mesh;
+}
+
+int CRTSceneParser::parseMaterialIndex(const rapidjson::Value& val)
+{
 	int materialIndex;
-	const Value& materialVal = val.FindMember("material_index")->value;
+	const Value& materialVal = getMember(val, "material_index");
 	if (!materialVal.IsNull())
 	{
 		materialIndex = materialVal.GetInt();
 	}
 
-	mesh.setMaterialIndex(materialIndex);
-	mesh.calculateVertexNormals();
-
-	scene.geometryObjects.push_back(mesh); //possible std::move
+	return materialIndex;
 }
 
-void CRTSceneParser::parseObjects(const rapidjson::Document& doc, CRTScene& scene)
+void CRTSceneParser::parseObjects(const rapidjson::Document& doc, CRTScene& scene, CRTSceneChanges& changes)
 {
-	const Value& objectsVal = doc.FindMember("objects")->value;
+	std::vector<uint64_t>& hashes = scene.sourceHashes.objects;
+	int objectsCount = 0;
+
+	const Value& objectsVal = getMember(doc, "objects");
 	if (!objectsVal.IsNull() && objectsVal.IsArray())
 	{
-		int objectsCount = objectsVal.GetArray().Size();
+		objectsCount = objectsVal.GetArray().Size();
+		hashes.resize(std::min(hashes.size(), scene.geometryObjects.size()));
+		scene.geometryObjects.reserve(objectsCount);
+		hashes.reserve(objectsCount);
 
 		for (int i = 0; i < objectsCount; i++)
 		{
-			const Value& mesh = objectsVal.GetArray()[i];
-			parseMesh(mesh, scene);
+			const Value& meshVal = objectsVal.GetArray()[i];
+			const uint64_t hash = hashMeshGeometry(meshVal);
+
+			// Unchanged geometry keeps its vertex normals and triangle stream
+			if (i < static_cast<int>(hashes.size()) && hashes[i] == hash)
+			{
+				scene.geometryObjects[i].setMaterialIndex(parseMaterialIndex(meshVal));
+				continue;
+			}
+
+			CRTMesh mesh = parseMesh(meshVal, scene, i);
+			if (i < static_cast<int>(scene.geometryObjects.size()))
+			{
+				scene.geometryObjects[i] = std::move(mesh);
+				hashes[i] = hash;
+			}
+			else
+			{
+				scene.geometryObjects.push_back(std::move(mesh));
+				hashes.push_back(hash);
+			}
+			changes.meshesRebuilt++;
 		}
 	}
+
+	if (static_cast<int>(scene.geometryObjects.size()) > objectsCount)
+	{
+		changes.meshesRemoved = static_cast<int>(scene.geometryObjects.size()) - objectsCount;
+		scene.geometryObjects.resize(objectsCount);
+		hashes.resize(objectsCount);
+	}
 }
 
 
-void CRTSceneParser::parseLights(const rapidjson::Document& doc, CRTScene& scene)
+void CRTSceneParser::parseLights(const rapidjson::Document& doc, CRTScene& scene, CRTSceneChanges& changes)
 {
-	const Value& lightsVal = doc.FindMember("lights")->value;
+	const uint64_t hash = hashSection(doc, "lights");
+	changes.lights = !scene.sourceHashes.valid || hash != scene.sourceHashes.lights;
+	scene.sourceHashes.lights = hash;
+
+	if (!changes.lights)
+	{
+		return;
+	}
+
+	scene.lights.clear();
+
+	const Value& lightsVal = getMember(doc, "lights");
 
 	if (!lightsVal.IsNull() && lightsVal.IsArray())
 	{
 		int lightsCount = lightsVal.GetArray().Size();
+		scene.lights.reserve(lightsCount);
 
 		for (int i = 0; i < lightsCount; i++)
 		{
@@ -161,6 +327,14 @@ void CRTSceneParser::parseLights(const rapidjson::Document& doc, CRTScene& scene
 			parseLight(light, scene);
 		}
 	}
+
+	{
+		CRT_TIMELINE_ZONE("build light tree");
+
+		auto buildStart = std::chrono::steady_clock::now();
+		scene.lightTree.build(scene.lights);
+		scene.buildSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count();
+	}
 }
 
 void CRTSceneParser::parseLight(const rapidjson::Value& val, CRTScene& scene)
@@ -168,49 +342,80 @@ void CRTSceneParser::parseLight(const rapidjson::Value& val, CRTScene& scene)
 	CRTVector position;
 	float intensity = 0.f;
 
-	const Value& positionVal = val.FindMember("position")->value;
+	const Value& positionVal = getMember(val, "position");
 	if (!positionVal.IsNull() && positionVal.IsArray())
 	{
 		position = loadVector(positionVal.GetArray(), 0);
 	}
 
-	const Value& intensityVal = val.FindMember("intensity")->value;
+	const Value& intensityVal = getMember(val, "intensity");
 	if (!intensityVal.IsNull())
 	{
 		intensity = intensityVal.GetFloat();
 	}
 
-	CRTLight light(position, intensity);
-
 	/*std::cout << "light:\n";
 	position.print(std::cout);
 	std::cout << intensity << std::endl;*/
 
-	scene.lights.push_back(light);
+	scene.lights.emplace_back(position, intensity);
 }
 
-void CRTSceneParser::parseTextures(const rapidjson::Document& doc, CRTScene& scene)
+void CRTSceneParser::parseTextures(const rapidjson::Document& doc, CRTScene& scene, CRTSceneChanges& changes)
 {
-	const Value& texturesVal = doc.FindMember("textures")->value;
+	std::vector<uint64_t>& hashes = scene.sourceHashes.textures;
+	int texturesCount = 0;
 
+	const Value& texturesVal = getMember(doc, "textures");
 	if (!texturesVal.IsNull() && texturesVal.IsArray())
 	{
-		int texturesCount = texturesVal.GetArray().Size();
+		texturesCount = texturesVal.GetArray().Size();
+		hashes.resize(std::min(hashes.size(), scene.textures.size()));
+		scene.textures.reserve(texturesCount);
+		hashes.reserve(texturesCount);
 
 		for (int i = 0; i < texturesCount; i++)
 		{
-			const Value& texture = texturesVal.GetArray()[i];
-			parseTexture(texture, scene);
+			const Value& textureVal = texturesVal.GetArray()[i];
+			const uint64_t hash = hashValue(textureVal);
+
+			// Bitmaps are loaded again only when their entry changed
+			if (i < static_cast<int>(hashes.size()) && hashes[i] == hash)
+			{
+				continue;
+			}
+
+			CRTTexture* texture = parseTexture(textureVal);
+			if (i < static_cast<int>(scene.textures.size()))
+			{
+				delete scene.textures[i];
+				scene.textures[i] = texture;
+				hashes[i] = hash;
+			}
+			else
+			{
+				scene.textures.push_back(texture);
+				hashes.push_back(hash);
+			}
+			changes.texturesLoaded++;
 		}
 	}
+
+	while (static_cast<int>(scene.textures.size()) > texturesCount)
+	{
+		delete scene.textures.back();
+		scene.textures.pop_back();
+		changes.texturesRemoved++;
+	}
+	hashes.resize(texturesCount);
 }
 
-void CRTSceneParser::parseTexture(const rapidjson::Value& val, CRTScene& scene)
+CRTTexture* CRTSceneParser::parseTexture(const rapidjson::Value& val)
 {
 	CRTTexture* textureToAdd = nullptr;
 	std::string name;
 
-	const Value& nameVal = val.FindMember("name")->value;
+	const Value& nameVal = getMember(val, "name");
 	if (!nameVal.IsNull())
 	{
 		name = nameVal.GetString();
@@ -219,7 +424,7 @@ void CRTSceneParser::parseTexture(const rapidjson::Value& val, CRTScene& scene)
 
 	std::string type;
 
-	const Value& typeVal = val.FindMember("type")->value;
+	const Value& typeVal = getMember(val, "type");
 	if (!typeVal.IsNull())
 	{
 		type = typeVal.GetString();
@@ -229,7 +434,7 @@ void CRTSceneParser::parseTexture(const rapidjson::Value& val, CRTScene& scene)
 	{
 		CRTVector albedo;
 
-		const Value& albedoVal = val.FindMember("albedo")->value;
+		const Value& albedoVal = getMember(val, "albedo");
 		if (!albedoVal.IsNull())
 		{
 			albedo = loadVector(albedoVal.GetArray(), 0);
@@ -242,19 +447,19 @@ void CRTSceneParser::parseTexture(const rapidjson::Value& val, CRTScene& scene)
 		CRTVector edgeColor, innerColor;
 		float edgeWidth;
 
-		const Value& edgeColorVal = val.FindMember("edge_color")->value;
+		const Value& edgeColorVal = getMember(val, "edge_color");
 		if (!edgeColorVal.IsNull())
 		{
 			edgeColor = loadVector(edgeColorVal.GetArray(), 0);
 		}
 
-		const Value& innerColorVal = val.FindMember("inner_color")->value;
+		const Value& innerColorVal = getMember(val, "inner_color");
 		if (!innerColorVal.IsNull())
 		{
 			innerColor = loadVector(innerColorVal.GetArray(), 0);
 		}
 
-		const Value& edgeWidthVal = val.FindMember("edge_width")->value;
+		const Value& edgeWidthVal = getMember(val, "edge_width");
 		if (!edgeWidthVal.IsNull())
 		{
 			edgeWidth = edgeWidthVal.GetFloat();
@@ -267,19 +472,19 @@ void CRTSceneParser::parseTexture(const rapidjson::Value& val, CRTScene& scene)
 		CRTVector colorA, colorB;
 		float squareSize;
 
-		const Value& colorAVal = val.FindMember("color_A")->value;
+		const Value& colorAVal = getMember(val, "color_A");
 		if (!colorAVal.IsNull())
 		{
 			colorA = loadVector(colorAVal.GetArray(), 0);
 		}
 
-		const Value& colorBVal = val.FindMember("color_B")->value;
+		const Value& colorBVal = getMember(val, "color_B");
 		if (!colorBVal.IsNull())
 		{
 			colorB = loadVector(colorBVal.GetArray(), 0);
 		}
 
-		const Value& squareSizeVal = val.FindMember("square_size")->value;
+		const Value& squareSizeVal = getMember(val, "square_size");
 		if (!squareSizeVal.IsNull())
 		{
 			squareSize = squareSizeVal.GetFloat();
@@ -291,7 +496,7 @@ void CRTSceneParser::parseTexture(const rapidjson::Value& val, CRTScene& scene)
 	{
 		std::string filePath;
 
-		const Value& filePathVal = val.FindMember("file_path")->value;
+		const Value& filePathVal = getMember(val, "file_path");
 		if (!filePathVal.IsNull())
 		{
 			filePath = filePathVal.GetString();
@@ -300,17 +505,24 @@ void CRTSceneParser::parseTexture(const rapidjson::Value& val, CRTScene& scene)
 		textureToAdd = new CRTTextureBitmap(filePath, name);
 	}
 
-	scene.textures.push_back(textureToAdd);
+	return textureToAdd;
 }
 
-void CRTSceneParser::parseMaterials(const rapidjson::Document& doc, CRTScene& scene)
+void CRTSceneParser::parseMaterials(const rapidjson::Document& doc, CRTScene& scene, CRTSceneChanges& changes)
 {
-	const Value& materialsVal = doc.FindMember("materials")->value;
+	const uint64_t hash = hashSection(doc, "materials");
+	changes.materials = !scene.sourceHashes.valid || hash != scene.sourceHashes.materials;
+	scene.sourceHashes.materials = hash;
+
+	scene.materials.clear();
+
+	const Value& materialsVal = getMember(doc, "materials");
 
 	if (!materialsVal.IsNull() && materialsVal.IsArray())
 	{
 		int materialsCount = materialsVal.GetArray().Size();
 		//std::cout << "materialsCount:\n" << materialsCount << std::endl;
+		scene.materials.reserve(materialsCount);
 
 		for (int i = 0; i < materialsCount; i++)
 		{
@@ -348,7 +560,7 @@ void CRTSceneParser::parseMaterial(const rapidjson::Value& val, CRTScene& scene)
 	float ior;
 	CRTMaterial material;
 
-	const Value& typeVal = val.FindMember("type")->value;
+	const Value& typeVal = getMember(val, "type");
 	if (!typeVal.IsNull())
 	{
 		type = getMaterialTypeFromString(typeVal.GetString());
@@ -357,7 +569,7 @@ void CRTSceneParser::parseMaterial(const rapidjson::Value& val, CRTScene& scene)
 
 	if (type == CRTMaterialType::REFRACTIVE)
 	{
-		const Value& iorVal = val.FindMember("ior")->value;
+		const Value& iorVal = getMember(val, "ior");
 		if (!iorVal.IsNull())
 		{
 			ior = iorVal.GetFloat();
@@ -368,7 +580,7 @@ void CRTSceneParser::parseMaterial(const rapidjson::Value& val, CRTScene& scene)
 	}
 	else
 	{
-		const Value& albedoVal = val.FindMember("albedo")->value;
+		const Value& albedoVal = getMember(val, "albedo");
 		if (!albedoVal.IsNull() && albedoVal.IsArray())
 		{
 			albedo = loadVector(albedoVal.GetArray(), 0);
@@ -381,14 +593,13 @@ void CRTSceneParser::parseMaterial(const rapidjson::Value& val, CRTScene& scene)
 		}
 	}
 
-	const Value& smoothShadingVal = val.FindMember("smooth_shading")->value;
+	const Value& smoothShadingVal = getMember(val, "smooth_shading");
 	if (!smoothShadingVal.IsNull())
 	{
 		smoothShading = smoothShadingVal.GetBool();
 	}
 	material.setSmoothShading(smoothShading);
 
-	scene.materials.push_back(material);
 
 	std::cout << "textureName:\n";
 	std::cout << material.getTextureName() << std::endl;
@@ -400,10 +611,17 @@ void CRTSceneParser::parseMaterial(const rapidjson::Value& val, CRTScene& scene)
 	std::cout << (int)type << std::endl;
 	std::cout << "ior:\n";
 	std::cout << ior << std::endl;
+
+	scene.materials.push_back(std::move(material));
 }
 
-void CRTSceneParser::parseScene(const std::string& sceneFileName, CRTScene& scene)
+CRTSceneChanges CRTSceneParser::parseScene(const std::string& sceneFileName, CRTScene& scene)
 {
+	CRT_TIMELINE_ZONE("parse scene");
+
+	auto parseStart = std::chrono::steady_clock::now();
+	scene.buildSeconds = 0.0;
+
 	std::ifstream ifs(sceneFileName);
 	assert(ifs.is_open());
 
@@ -411,15 +629,53 @@ void CRTSceneParser::parseScene(const std::string& sceneFileName, CRTScene& scen
 	rapidjson::Document doc;
 	doc.ParseStream(isw);
 
-	parseSettings(doc, scene);
-	parseCamera(doc, scene);
-	parseObjects(doc, scene);
-	parseLights(doc, scene);
-	parseMaterials(doc, scene);
-	parseTextures(doc, scene);
+	CRTSceneChanges changes;
+	// A file caught in the middle of being saved leaves the loaded scene as it is
+	if (doc.HasParseError() || !doc.IsObject())
+	{
+		std::cout << "Failed to parse " << sceneFileName << std::endl;
+		return changes;
+	}
+
+	parseSettings(doc, scene, changes);
+	parseCamera(doc, scene, changes);
+	parseObjects(doc, scene, changes);
+	parseLights(doc, scene, changes);
+	parseMaterials(doc, scene, changes);
+	parseTextures(doc, scene, changes);
+	scene.sourceHashes.valid = true;
+
+	// Mesh preparation is reported separately as build time
+	double totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - parseStart).count();
+	scene.parseSeconds = totalSeconds - scene.buildSeconds;
 
 	/*for (auto& obj : scene.geometryObjects)
 	{
 		obj.print();
 	}*/
+
+	return changes;
+}
+
+bool CRTSceneParser::parseSettings(const std::string& sceneFileName, CRTSettings& settings)
+{
+	std::ifstream ifs(sceneFileName);
+	if (!ifs.is_open())
+	{
+		std::cout << "Failed to open " << sceneFileName << std::endl;
+		return false;
+	}
+
+	rapidjson::IStreamWrapper isw(ifs);
+	rapidjson::Document doc;
+	doc.ParseStream(isw);
+
+	if (doc.HasParseError() || !doc.IsObject() || !getMember(doc, "settings").IsObject())
+	{
+		std::cout << "Failed to parse the settings of " << sceneFileName << std::endl;
+		return false;
+	}
+
+	loadSettings(doc, settings);
+	return true;
 }
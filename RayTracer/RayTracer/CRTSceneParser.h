@@ -8,20 +8,26 @@ class CRTSceneParser
 private:
 	static CRTMatrix loadMatrix(const rapidjson::Value::ConstArray& arr);
 	static CRTVector loadVector(const rapidjson::Value::ConstArray& arr, int startIndex);
-	static void parseSettings(const rapidjson::Document& doc, CRTScene& scene);
-	static void parseCamera(const rapidjson::Document& doc, CRTScene& scene);
-	static void parseMesh(const rapidjson::Value& val, CRTScene& scene);
-	static void parseObjects(const rapidjson::Document& doc, CRTScene& scene);
-	static void parseLights(const rapidjson::Document& doc, CRTScene& scene);
+	static void loadSettings(const rapidjson::Document& doc, CRTSettings& settings);
+	static void parseSettings(const rapidjson::Document& doc, CRTScene& scene, CRTSceneChanges& changes);
+	static void parseCamera(const rapidjson::Document& doc, CRTScene& scene, CRTSceneChanges& changes);
+	static CRTMesh parseMesh(const rapidjson::Value& val, CRTScene& scene, int meshIdx);
+	static int parseMaterialIndex(const rapidjson::Value& val);
+	static void parseObjects(const rapidjson::Document& doc, CRTScene& scene, CRTSceneChanges& changes);
+	static void parseLights(const rapidjson::Document& doc, CRTScene& scene, CRTSceneChanges& changes);
 	static void parseLight(const rapidjson::Value& val, CRTScene& scene);
 
-	static void parseTextures(const rapidjson::Document& doc, CRTScene& scene);
-	static void parseTexture(const rapidjson::Value& val, CRTScene& scene);
+	static void parseTextures(const rapidjson::Document& doc, CRTScene& scene, CRTSceneChanges& changes);
+	static CRTTexture* parseTexture(const rapidjson::Value& val);
 
-	static void parseMaterials(const rapidjson::Document& doc, CRTScene& scene);
+	static void parseMaterials(const rapidjson::Document& doc, CRTScene& scene, CRTSceneChanges& changes);
 	static void parseMaterial(const rapidjson::Value& val, CRTScene& scene);
 
 public:
-	static void parseScene(const std::string& sceneFileName, CRTScene& scene);
+	// Loads the scene file into scene. When scene was loaded before, only the meshes and textures
+	// whose part of the file changed are prepared again.
+	static CRTSceneChanges parseScene(const std::string& sceneFileName, CRTScene& scene);
+	// Reads only the settings of the scene file into settings, no mesh or texture is prepared.
+	// Returns false when the file has no readable settings.
+	static bool parseSettings(const std::string& sceneFileName, CRTSettings& settings);
 };
-
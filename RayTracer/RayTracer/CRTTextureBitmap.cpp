@@ -1,16 +1,28 @@
 #include "CRTTextureBitmap.h"
 #include "stb_image/stb_image.h"
+#include "CRTTimeline.h"
 #include <iostream>
 
 CRTTextureBitmap::CRTTextureBitmap(const std::string& filepath, const std::string& name)
     : CRTTexture(name)
 {
-    
+    CRT_TIMELINE_ZONE("decode texture");
+
     buffer = stbi_load(filepath.c_str(), &width, &height, &channels, 0);
+
+    if (buffer == nullptr)
+    {
+        std::cout << "Failed to load texture " << filepath << std::endl;
+    }
 }
 
 CRTVector CRTTextureBitmap::getColor(float u, float v) const
 {
+    if (buffer == nullptr)
+    {
+        return CRTVector();
+    }
+
     // Clamp UVs to [0,1] to avoid out-of-bounds access
     u = std::fmin(std::fmax(u, 0.0f), 1.0f);
     v = std::fmin(std::fmax(v, 0.0f), 1.0f);
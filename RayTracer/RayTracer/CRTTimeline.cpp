@@ -0,0 +1,180 @@
+#include "CRTTimeline.h"
+
+#ifdef CRT_ENABLE_TIMELINE
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "rapidjson/writer.h"
+#include "rapidjson/ostreamwrapper.h"
+
+struct CRTTimelineEvent
+{
+	const char* name;
+	int index;
+	long long startNs;
+	long long endNs;
+};
+
+struct CRTTimelineBuffer
+{
+	int threadId = 0;
+	// Taken by a running thread, a finished thread hands it on to the next new one
+	bool inUse = false;
+	std::vector<CRTTimelineEvent> events;
+};
+
+// Buffers are owned here so they outlive the threads that filled them.
+// The mutex is only taken when a thread records its first zone, when it ends and on export.
+static std::mutex buffersMutex;
+static std::vector<std::unique_ptr<CRTTimelineBuffer>> buffers;
+
+// Gives the buffer of the thread back when the thread ends. The render workers are started
+// again for every frame and pass, reusing their buffers keeps one track per worker.
+struct CRTTimelineThreadBuffer
+{
+	CRTTimelineBuffer* buffer = nullptr;
+
+	~CRTTimelineThreadBuffer()
+	{
+		if (buffer != nullptr)
+		{
+			std::lock_guard<std::mutex> lock(buffersMutex);
+			buffer->inUse = false;
+		}
+	}
+};
+
+static thread_local CRTTimelineThreadBuffer threadBuffer;
+
+static const std::chrono::steady_clock::time_point timelineStart = std::chrono::steady_clock::now();
+
+static CRTTimelineBuffer* getThreadBuffer()
+{
+	if (threadBuffer.buffer == nullptr)
+	{
+		std::lock_guard<std::mutex> lock(buffersMutex);
+
+		for (const auto& buffer : buffers)
+		{
+			if (!buffer->inUse)
+			{
+				threadBuffer.buffer = buffer.get();
+				break;
+			}
+		}
+
+		if (threadBuffer.buffer == nullptr)
+		{
+			buffers.push_back(std::make_unique<CRTTimelineBuffer>());
+			threadBuffer.buffer = buffers.back().get();
+			threadBuffer.buffer->threadId = static_cast<int>(buffers.size());
+			threadBuffer.buffer->events.reserve(4096);
+		}
+
+		threadBuffer.buffer->inUse = true;
+	}
+
+	return threadBuffer.buffer;
+}
+
+long long CRTTimeline::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - timelineStart).count();
+}
+
+void CRTTimeline::record(const char* name, int index, long long startNs, long long endNs)
+{
+	getThreadBuffer()->events.push_back({ name, index, startNs, endNs });
+}
+
+void CRTTimeline::writeChromeTrace(const std::string& fileName)
+{
+	std::lock_guard<std::mutex> lock(buffersMutex);
+
+	std::ofstream ofs(fileName);
+	rapidjson::OStreamWrapper osw(ofs);
+	rapidjson::Writer<rapidjson::OStreamWrapper> writer(osw);
+
+	writer.StartObject();
+	writer.Key("displayTimeUnit");
+	writer.String("ms");
+	writer.Key("traceEvents");
+	writer.StartArray();
+
+	for (const auto& buffer : buffers)
+	{
+		const std::string threadName = "thread " + std::to_string(buffer->threadId);
+
+		writer.StartObject();
+		writer.Key("name");
+		writer.String("thread_name");
+		writer.Key("ph");
+		writer.String("M");
+		writer.Key("pid");
+		writer.Int(1);
+		writer.Key("tid");
+		writer.Int(buffer->threadId);
+		writer.Key("args");
+		writer.StartObject();
+		writer.Key("name");
+		writer.String(threadName.c_str());
+		writer.EndObject();
+		writer.EndObject();
+
+		for (const CRTTimelineEvent& event : buffer->events)
+		{
+			// Complete events, timestamps in microseconds
+			writer.StartObject();
+			writer.Key("name");
+			writer.String(event.name);
+			writer.Key("ph");
+			writer.String("X");
+			writer.Key("ts");
+			writer.Double(event.startNs / 1000.0);
+			writer.Key("dur");
+			writer.Double((event.endNs - event.startNs) / 1000.0);
+			writer.Key("pid");
+			writer.Int(1);
+			writer.Key("tid");
+			writer.Int(buffer->threadId);
+			if (event.index >= 0)
+			{
+				writer.Key("args");
+				writer.StartObject();
+				writer.Key("index");
+				writer.Int(event.index);
+				writer.EndObject();
+			}
+			writer.EndObject();
+		}
+	}
+
+	writer.EndArray();
+	writer.EndObject();
+	ofs << std::endl;
+}
+
+void CRTTimeline::clear()
+{
+	std::lock_guard<std::mutex> lock(buffersMutex);
+
+	for (const auto& buffer : buffers)
+	{
+		buffer->events.clear();
+	}
+}
+
+CRTTimelineZone::CRTTimelineZone(const char* name, int index)
+	: name(name), index(index), startNs(CRTTimeline::now())
+{
+}
+
+CRTTimelineZone::~CRTTimelineZone()
+{
+	CRTTimeline::record(name, index, startNs, CRTTimeline::now());
+}
+
+#endif
@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+
+// Timeline of the render phases, exported in the Chrome trace-event format that
+// chrome://tracing and Perfetto open. Every thread records its zones into its own
+// buffer without locking; the export must run after the rendering threads are done.
+// A thread that ends passes its buffer, and so its track, on to the next thread started.
+//
+// Compiled in only when CRT_ENABLE_TIMELINE is defined (add it to the preprocessor
+// definitions of the configuration). Otherwise the macros below expand to nothing.
+#ifdef CRT_ENABLE_TIMELINE
+
+class CRTTimeline
+{
+public:
+	static void record(const char* name, int index, long long startNs, long long endNs);
+	static long long now();
+
+	static void writeChromeTrace(const std::string& fileName);
+	static void clear();
+};
+
+// Records the time between its construction and destruction as one zone
+class CRTTimelineZone
+{
+public:
+	CRTTimelineZone(const char* name, int index = -1);
+	~CRTTimelineZone();
+
+	CRTTimelineZone(const CRTTimelineZone& other) = delete;
+	CRTTimelineZone& operator=(const CRTTimelineZone& other) = delete;
+
+private:
+	const char* name;
+	int index;
+	long long startNs;
+};
+
+#define CRT_TIMELINE_CONCAT_IMPL(a, b) a##b
+#define CRT_TIMELINE_CONCAT(a, b) CRT_TIMELINE_CONCAT_IMPL(a, b)
+
+// name must outlive the export, string literals only
+#define CRT_TIMELINE_ZONE(name) CRTTimelineZone CRT_TIMELINE_CONCAT(timelineZone, __LINE__)(name)
+#define CRT_TIMELINE_ZONE_INDEX(name, index) CRTTimelineZone CRT_TIMELINE_CONCAT(timelineZone, __LINE__)(name, index)
+#define CRT_TIMELINE_WRITE(fileName) CRTTimeline::writeChromeTrace(fileName)
+
+#else
+
+#define CRT_TIMELINE_ZONE(name)
+#define CRT_TIMELINE_ZONE_INDEX(name, index)
+#define CRT_TIMELINE_WRITE(fileName)
+
+#endif
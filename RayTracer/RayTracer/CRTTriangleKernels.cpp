@@ -0,0 +1,418 @@
+#include "CRTTriangleKernels.h"
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CRT_X86_SIMD 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define CRT_X86_SIMD 0
+#endif
+
+// MSVC compiles AVX intrinsics anywhere, GCC and Clang need the target on the function
+#if CRT_X86_SIMD && defined(__GNUC__)
+#define CRT_TARGET_AVX2 __attribute__((target("avx,avx2")))
+#else
+#define CRT_TARGET_AVX2
+#endif
+
+static const float PARALLEL_EPSILON = 0.0001f;
+static const float EDGE_EPSILON = CRTTriangleKernels::EDGE_EPSILON;
+
+// Picks the closest hit out of the per-lane results, lowest stream index on ties,
+// which is the hit the scalar kernel finds first
+static int reduceLanes(const float* laneT, const int* laneIdx, int width, float& closestT)
+{
+	int closestIdx = -1;
+
+	for (int lane = 0; lane < width; lane++)
+	{
+		if (laneIdx[lane] < 0)
+			continue;
+
+		if (closestIdx < 0 || laneT[lane] < closestT ||
+			(laneT[lane] == closestT && laneIdx[lane] < closestIdx))
+		{
+			closestT = laneT[lane];
+			closestIdx = laneIdx[lane];
+		}
+	}
+
+	return closestIdx;
+}
+
+// Plane and edge tests of one stream triangle, writes the distance of a hit in [0, maxT] to t
+static bool intersectTriangle(const CRTTriangleStream& stream, size_t i, const CRTVector& origin,
+							  const CRTVector& direction, float maxT, float& t)
+{
+	CRTVector v0(stream.getV0(0)[i], stream.getV0(1)[i], stream.getV0(2)[i]);
+	CRTVector e1(stream.getE1(0)[i], stream.getE1(1)[i], stream.getE1(2)[i]);
+	CRTVector e2(stream.getE2(0)[i], stream.getE2(1)[i], stream.getE2(2)[i]);
+
+	CRTVector normal = cross(e1, e2);
+	normal.normalise();
+
+	// Written as negated accept tests so the NaNs of degenerate lanes are rejected
+	float rProj = dot(direction, normal);
+	if (!(std::abs(rProj) >= PARALLEL_EPSILON))
+		return false;  // Parallel
+
+	t = dot(v0 - origin, normal) / rProj;
+	if (!(t >= 0.f && t <= maxT))
+		return false;
+
+	CRTVector v0P = (origin + t * direction) - v0;
+
+	if (dot(normal, cross(e1, v0P)) < EDGE_EPSILON)
+		return false;
+
+	if (dot(normal, cross(e2 - e1, v0P - e1)) < EDGE_EPSILON)
+		return false;
+
+	if (dot(normal, cross(e2 * -1.f, v0P - e2)) < EDGE_EPSILON)
+		return false;
+
+	return true;
+}
+
+int CRTTriangleKernels::intersectScalar(const CRTTriangleStream& stream, const CRTRay& ray, float maxT, float& closestT)
+{
+	const CRTVector& origin = ray.getOrigin();
+	const CRTVector& direction = ray.getDirection();
+
+	int closestIdx = -1;
+
+	for (size_t i = 0; i < stream.getTriangleCount(); i++)
+	{
+		float t;
+		if (intersectTriangle(stream, i, origin, direction, maxT, t) && t < closestT)
+		{
+			closestT = t;
+			closestIdx = static_cast<int>(i);
+		}
+	}
+
+	return closestIdx;
+}
+
+bool CRTTriangleKernels::intersectOne(const CRTTriangleStream& stream, int triangleIdx, const CRTRay& ray, float maxT, float& t)
+{
+	if (triangleIdx < 0 || static_cast<size_t>(triangleIdx) >= stream.getTriangleCount())
+		return false;
+
+	return intersectTriangle(stream, triangleIdx, ray.getOrigin(), ray.getDirection(), maxT, t);
+}
+
+int CRTTriangleKernels::intersectSSE(const CRTTriangleStream& stream, const CRTRay& ray, float maxT, float& closestT)
+{
+#if CRT_X86_SIMD
+	const __m128 ox = _mm_set1_ps(ray.getOrigin().getX());
+	const __m128 oy = _mm_set1_ps(ray.getOrigin().getY());
+	const __m128 oz = _mm_set1_ps(ray.getOrigin().getZ());
+	const __m128 dx = _mm_set1_ps(ray.getDirection().getX());
+	const __m128 dy = _mm_set1_ps(ray.getDirection().getY());
+	const __m128 dz = _mm_set1_ps(ray.getDirection().getZ());
+
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const __m128 parallelEpsilon = _mm_set1_ps(PARALLEL_EPSILON);
+	const __m128 edgeEpsilon = _mm_set1_ps(EDGE_EPSILON);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 maxTV = _mm_set1_ps(maxT);
+
+	__m128 bestT = _mm_set1_ps(closestT);
+	__m128i bestIdx = _mm_set1_epi32(-1);
+	__m128i laneIdx = _mm_set_epi32(3, 2, 1, 0);
+	const __m128i laneStep = _mm_set1_epi32(4);
+
+	for (size_t i = 0; i < stream.getPaddedCount(); i += 4)
+	{
+		const __m128 v0x = _mm_loadu_ps(stream.getV0(0) + i);
+		const __m128 v0y = _mm_loadu_ps(stream.getV0(1) + i);
+		const __m128 v0z = _mm_loadu_ps(stream.getV0(2) + i);
+		const __m128 e1x = _mm_loadu_ps(stream.getE1(0) + i);
+		const __m128 e1y = _mm_loadu_ps(stream.getE1(1) + i);
+		const __m128 e1z = _mm_loadu_ps(stream.getE1(2) + i);
+		const __m128 e2x = _mm_loadu_ps(stream.getE2(0) + i);
+		const __m128 e2y = _mm_loadu_ps(stream.getE2(1) + i);
+		const __m128 e2z = _mm_loadu_ps(stream.getE2(2) + i);
+
+		// normal = normalise(cross(e1, e2))
+		__m128 nx = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y));
+		__m128 ny = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z));
+		__m128 nz = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x));
+		const __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)));
+		nx = _mm_div_ps(nx, len);
+		ny = _mm_div_ps(ny, len);
+		nz = _mm_div_ps(nz, len);
+
+		const __m128 rProj = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, nx), _mm_mul_ps(dy, ny)), _mm_mul_ps(dz, nz));
+		__m128 mask = _mm_cmpge_ps(_mm_and_ps(rProj, absMask), parallelEpsilon);
+
+		const __m128 rpDist = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(_mm_sub_ps(v0x, ox), nx),
+			_mm_mul_ps(_mm_sub_ps(v0y, oy), ny)),
+			_mm_mul_ps(_mm_sub_ps(v0z, oz), nz));
+		const __m128 t = _mm_div_ps(rpDist, rProj);
+
+		mask = _mm_and_ps(mask, _mm_cmpge_ps(t, zero));
+		mask = _mm_and_ps(mask, _mm_cmple_ps(t, maxTV));
+		mask = _mm_and_ps(mask, _mm_cmplt_ps(t, bestT));
+
+		// v0P = origin + t * direction - v0
+		const __m128 px = _mm_sub_ps(_mm_add_ps(ox, _mm_mul_ps(dx, t)), v0x);
+		const __m128 py = _mm_sub_ps(_mm_add_ps(oy, _mm_mul_ps(dy, t)), v0y);
+		const __m128 pz = _mm_sub_ps(_mm_add_ps(oz, _mm_mul_ps(dz, t)), v0z);
+
+		// Edge v0 -> v1
+		{
+			const __m128 cx = _mm_sub_ps(_mm_mul_ps(e1y, pz), _mm_mul_ps(e1z, py));
+			const __m128 cy = _mm_sub_ps(_mm_mul_ps(e1z, px), _mm_mul_ps(e1x, pz));
+			const __m128 cz = _mm_sub_ps(_mm_mul_ps(e1x, py), _mm_mul_ps(e1y, px));
+			const __m128 side = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_mul_ps(nz, cz));
+			mask = _mm_and_ps(mask, _mm_cmpge_ps(side, edgeEpsilon));
+		}
+
+		// Edge v1 -> v2
+		{
+			const __m128 ax = _mm_sub_ps(e2x, e1x);
+			const __m128 ay = _mm_sub_ps(e2y, e1y);
+			const __m128 az = _mm_sub_ps(e2z, e1z);
+			const __m128 bx = _mm_sub_ps(px, e1x);
+			const __m128 by = _mm_sub_ps(py, e1y);
+			const __m128 bz = _mm_sub_ps(pz, e1z);
+			const __m128 cx = _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by));
+			const __m128 cy = _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz));
+			const __m128 cz = _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx));
+			const __m128 side = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_mul_ps(nz, cz));
+			mask = _mm_and_ps(mask, _mm_cmpge_ps(side, edgeEpsilon));
+		}
+
+		// Edge v2 -> v0
+		{
+			const __m128 ax = _mm_sub_ps(zero, e2x);
+			const __m128 ay = _mm_sub_ps(zero, e2y);
+			const __m128 az = _mm_sub_ps(zero, e2z);
+			const __m128 bx = _mm_sub_ps(px, e2x);
+			const __m128 by = _mm_sub_ps(py, e2y);
+			const __m128 bz = _mm_sub_ps(pz, e2z);
+			const __m128 cx = _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by));
+			const __m128 cy = _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz));
+			const __m128 cz = _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx));
+			const __m128 side = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_mul_ps(nz, cz));
+			mask = _mm_and_ps(mask, _mm_cmpge_ps(side, edgeEpsilon));
+		}
+
+		// SSE2 has no blend, select with and/andnot/or
+		bestT = _mm_or_ps(_mm_and_ps(mask, t), _mm_andnot_ps(mask, bestT));
+		const __m128i maskI = _mm_castps_si128(mask);
+		bestIdx = _mm_or_si128(_mm_and_si128(maskI, laneIdx), _mm_andnot_si128(maskI, bestIdx));
+
+		laneIdx = _mm_add_epi32(laneIdx, laneStep);
+	}
+
+	alignas(16) float laneT[4];
+	alignas(16) int laneIdxOut[4];
+	_mm_store_ps(laneT, bestT);
+	_mm_store_si128(reinterpret_cast<__m128i*>(laneIdxOut), bestIdx);
+
+	return reduceLanes(laneT, laneIdxOut, 4, closestT);
+#else
+	return intersectScalar(stream, ray, maxT, closestT);
+#endif
+}
+
+CRT_TARGET_AVX2
+int CRTTriangleKernels::intersectAVX2(const CRTTriangleStream& stream, const CRTRay& ray, float maxT, float& closestT)
+{
+#if CRT_X86_SIMD
+	const __m256 ox = _mm256_set1_ps(ray.getOrigin().getX());
+	const __m256 oy = _mm256_set1_ps(ray.getOrigin().getY());
+	const __m256 oz = _mm256_set1_ps(ray.getOrigin().getZ());
+	const __m256 dx = _mm256_set1_ps(ray.getDirection().getX());
+	const __m256 dy = _mm256_set1_ps(ray.getDirection().getY());
+	const __m256 dz = _mm256_set1_ps(ray.getDirection().getZ());
+
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	const __m256 parallelEpsilon = _mm256_set1_ps(PARALLEL_EPSILON);
+	const __m256 edgeEpsilon = _mm256_set1_ps(EDGE_EPSILON);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 maxTV = _mm256_set1_ps(maxT);
+
+	__m256 bestT = _mm256_set1_ps(closestT);
+	__m256i bestIdx = _mm256_set1_epi32(-1);
+	__m256i laneIdx = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+	const __m256i laneStep = _mm256_set1_epi32(8);
+
+	for (size_t i = 0; i < stream.getPaddedCount(); i += 8)
+	{
+		const __m256 v0x = _mm256_loadu_ps(stream.getV0(0) + i);
+		const __m256 v0y = _mm256_loadu_ps(stream.getV0(1) + i);
+		const __m256 v0z = _mm256_loadu_ps(stream.getV0(2) + i);
+		const __m256 e1x = _mm256_loadu_ps(stream.getE1(0) + i);
+		const __m256 e1y = _mm256_loadu_ps(stream.getE1(1) + i);
+		const __m256 e1z = _mm256_loadu_ps(stream.getE1(2) + i);
+		const __m256 e2x = _mm256_loadu_ps(stream.getE2(0) + i);
+		const __m256 e2y = _mm256_loadu_ps(stream.getE2(1) + i);
+		const __m256 e2z = _mm256_loadu_ps(stream.getE2(2) + i);
+
+		// normal = normalise(cross(e1, e2))
+		__m256 nx = _mm256_sub_ps(_mm256_mul_ps(e1y, e2z), _mm256_mul_ps(e1z, e2y));
+		__m256 ny = _mm256_sub_ps(_mm256_mul_ps(e1z, e2x), _mm256_mul_ps(e1x, e2z));
+		__m256 nz = _mm256_sub_ps(_mm256_mul_ps(e1x, e2y), _mm256_mul_ps(e1y, e2x));
+		const __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)), _mm256_mul_ps(nz, nz)));
+		nx = _mm256_div_ps(nx, len);
+		ny = _mm256_div_ps(ny, len);
+		nz = _mm256_div_ps(nz, len);
+
+		const __m256 rProj = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, nx), _mm256_mul_ps(dy, ny)), _mm256_mul_ps(dz, nz));
+		__m256 mask = _mm256_cmp_ps(_mm256_and_ps(rProj, absMask), parallelEpsilon, _CMP_GE_OQ);
+
+		const __m256 rpDist = _mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(_mm256_sub_ps(v0x, ox), nx),
+			_mm256_mul_ps(_mm256_sub_ps(v0y, oy), ny)),
+			_mm256_mul_ps(_mm256_sub_ps(v0z, oz), nz));
+		const __m256 t = _mm256_div_ps(rpDist, rProj);
+
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, zero, _CMP_GE_OQ));
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, maxTV, _CMP_LE_OQ));
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, bestT, _CMP_LT_OQ));
+
+		// v0P = origin + t * direction - v0
+		const __m256 px = _mm256_sub_ps(_mm256_add_ps(ox, _mm256_mul_ps(dx, t)), v0x);
+		const __m256 py = _mm256_sub_ps(_mm256_add_ps(oy, _mm256_mul_ps(dy, t)), v0y);
+		const __m256 pz = _mm256_sub_ps(_mm256_add_ps(oz, _mm256_mul_ps(dz, t)), v0z);
+
+		// Edge v0 -> v1
+		{
+			const __m256 cx = _mm256_sub_ps(_mm256_mul_ps(e1y, pz), _mm256_mul_ps(e1z, py));
+			const __m256 cy = _mm256_sub_ps(_mm256_mul_ps(e1z, px), _mm256_mul_ps(e1x, pz));
+			const __m256 cz = _mm256_sub_ps(_mm256_mul_ps(e1x, py), _mm256_mul_ps(e1y, px));
+			const __m256 side = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_mul_ps(ny, cy)), _mm256_mul_ps(nz, cz));
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(side, edgeEpsilon, _CMP_GE_OQ));
+		}
+
+		// Edge v1 -> v2
+		{
+			const __m256 ax = _mm256_sub_ps(e2x, e1x);
+			const __m256 ay = _mm256_sub_ps(e2y, e1y);
+			const __m256 az = _mm256_sub_ps(e2z, e1z);
+			const __m256 bx = _mm256_sub_ps(px, e1x);
+			const __m256 by = _mm256_sub_ps(py, e1y);
+			const __m256 bz = _mm256_sub_ps(pz, e1z);
+			const __m256 cx = _mm256_sub_ps(_mm256_mul_ps(ay, bz), _mm256_mul_ps(az, by));
+			const __m256 cy = _mm256_sub_ps(_mm256_mul_ps(az, bx), _mm256_mul_ps(ax, bz));
+			const __m256 cz = _mm256_sub_ps(_mm256_mul_ps(ax, by), _mm256_mul_ps(ay, bx));
+			const __m256 side = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_mul_ps(ny, cy)), _mm256_mul_ps(nz, cz));
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(side, edgeEpsilon, _CMP_GE_OQ));
+		}
+
+		// Edge v2 -> v0
+		{
+			const __m256 ax = _mm256_sub_ps(zero, e2x);
+			const __m256 ay = _mm256_sub_ps(zero, e2y);
+			const __m256 az = _mm256_sub_ps(zero, e2z);
+			const __m256 bx = _mm256_sub_ps(px, e2x);
+			const __m256 by = _mm256_sub_ps(py, e2y);
+			const __m256 bz = _mm256_sub_ps(pz, e2z);
+			const __m256 cx = _mm256_sub_ps(_mm256_mul_ps(ay, bz), _mm256_mul_ps(az, by));
+			const __m256 cy = _mm256_sub_ps(_mm256_mul_ps(az, bx), _mm256_mul_ps(ax, bz));
+			const __m256 cz = _mm256_sub_ps(_mm256_mul_ps(ax, by), _mm256_mul_ps(ay, bx));
+			const __m256 side = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_mul_ps(ny, cy)), _mm256_mul_ps(nz, cz));
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(side, edgeEpsilon, _CMP_GE_OQ));
+		}
+
+		bestT = _mm256_blendv_ps(bestT, t, mask);
+		bestIdx = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(bestIdx), _mm256_castsi256_ps(laneIdx), mask));
+
+		laneIdx = _mm256_add_epi32(laneIdx, laneStep);
+	}
+
+	alignas(32) float laneT[8];
+	alignas(32) int laneIdxOut[8];
+	_mm256_store_ps(laneT, bestT);
+	_mm256_store_si256(reinterpret_cast<__m256i*>(laneIdxOut), bestIdx);
+
+	return reduceLanes(laneT, laneIdxOut, 8, closestT);
+#else
+	return intersectScalar(stream, ray, maxT, closestT);
+#endif
+}
+
+static bool detectAVX2()
+{
+#if CRT_X86_SIMD && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx)
+		return false;
+
+	// The OS has to save the YMM registers on context switches
+	if ((_xgetbv(0) & 0x6) != 0x6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif CRT_X86_SIMD
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+
+bool CRTTriangleKernels::isSupported(CRTKernelType type)
+{
+	static const bool hasAVX2 = detectAVX2();
+
+	if (type == CRTKernelType::AVX2)
+		return hasAVX2;
+
+	if (type == CRTKernelType::SSE)
+		return CRT_X86_SIMD != 0; //SSE2 is part of every x86 target we build for
+
+	return true;
+}
+
+CRTKernelType CRTTriangleKernels::getBestSupported()
+{
+	if (isSupported(CRTKernelType::AVX2))
+		return CRTKernelType::AVX2;
+
+	if (isSupported(CRTKernelType::SSE))
+		return CRTKernelType::SSE;
+
+	return CRTKernelType::SCALAR;
+}
+
+CRTTriangleKernels::Kernel CRTTriangleKernels::getKernel(CRTKernelType type)
+{
+	if (!isSupported(type))
+		return &intersectScalar;
+
+	if (type == CRTKernelType::AVX2)
+		return &intersectAVX2;
+
+	if (type == CRTKernelType::SSE)
+		return &intersectSSE;
+
+	return &intersectScalar;
+}
+
+const char* CRTTriangleKernels::getName(CRTKernelType type)
+{
+	if (type == CRTKernelType::AVX2)
+		return "avx2";
+
+	if (type == CRTKernelType::SSE)
+		return "sse";
+
+	return "scalar";
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "CRTTriangleStream.h"
+#include "Math/CRTRay.h"
+
+enum class CRTKernelType
+{
+	SCALAR,
+	SSE, //4 triangles per iteration
+	AVX2 //8 triangles per iteration
+};
+
+// Ray against triangle stream intersection kernels. All kernels use the same plane and
+// edge tests, so they agree with each other up to float rounding.
+// A kernel accepts only hits in [0, maxT] that are closer than closestT. It returns the
+// stream index of the closest such hit and writes its distance to closestT, or returns -1.
+class CRTTriangleKernels
+{
+public:
+	using Kernel = int (*)(const CRTTriangleStream& stream, const CRTRay& ray, float maxT, float& closestT);
+
+	// Edge test tolerance, a hit may lie up to -EDGE_EPSILON / edge length outside the triangle
+	static constexpr float EDGE_EPSILON = -0.00001f;
+
+	static int intersectScalar(const CRTTriangleStream& stream, const CRTRay& ray, float maxT, float& closestT);
+	static int intersectSSE(const CRTTriangleStream& stream, const CRTRay& ray, float maxT, float& closestT);
+	static int intersectAVX2(const CRTTriangleStream& stream, const CRTRay& ray, float maxT, float& closestT);
+
+	// Same tests against the single triangle triangleIdx of the stream, t receives the hit distance
+	static bool intersectOne(const CRTTriangleStream& stream, int triangleIdx, const CRTRay& ray, float maxT, float& t);
+
+	static bool isSupported(CRTKernelType type);
+	static CRTKernelType getBestSupported();
+	static Kernel getKernel(CRTKernelType type);
+	static const char* getName(CRTKernelType type);
+};
@@ -0,0 +1,92 @@
+#include "CRTTriangleStream.h"
+
+void CRTTriangleStream::build(const std::vector<CRTVector>& vertices, const std::vector<int>& indices)
+{
+	triangleCount = indices.size() / 3;
+
+	size_t paddedCount = (triangleCount + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		// Padding lanes stay zero, a triangle with zero edges never reports a hit
+		v0[axis].assign(paddedCount, 0.f);
+		e1[axis].assign(paddedCount, 0.f);
+		e2[axis].assign(paddedCount, 0.f);
+	}
+
+	for (size_t i = 0; i < triangleCount; i++)
+	{
+		size_t idx0 = indices[i * 3];
+		size_t idx1 = indices[i * 3 + 1];
+		size_t idx2 = indices[i * 3 + 2];
+
+		// Invalid triangles are kept as degenerate lanes so stream and index buffer stay aligned
+		if (idx0 >= vertices.size() || idx1 >= vertices.size() || idx2 >= vertices.size())
+			continue;
+
+		const CRTVector& vert0 = vertices[idx0];
+		const CRTVector& vert1 = vertices[idx1];
+		const CRTVector& vert2 = vertices[idx2];
+
+		if ((vert1 - vert0).length() < 1e-6f || (vert2 - vert1).length() < 1e-6f || (vert0 - vert2).length() < 1e-6f)
+			continue;
+
+		CRTVector edge1 = vert1 - vert0;
+		CRTVector edge2 = vert2 - vert0;
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			v0[axis][i] = vert0.getByIndex(axis);
+			e1[axis][i] = edge1.getByIndex(axis);
+			e2[axis][i] = edge2.getByIndex(axis);
+		}
+	}
+}
+
+void CRTTriangleStream::clear()
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		v0[axis].clear();
+		e1[axis].clear();
+		e2[axis].clear();
+	}
+
+	triangleCount = 0;
+}
+
+bool CRTTriangleStream::isEmpty() const
+{
+	return triangleCount == 0;
+}
+
+size_t CRTTriangleStream::getTriangleCount() const
+{
+	return triangleCount;
+}
+
+size_t CRTTriangleStream::getPaddedCount() const
+{
+	return v0[0].size();
+}
+
+size_t CRTTriangleStream::getMemoryBytes() const
+{
+	// Nine arrays, a position and two edges per axis
+	return getPaddedCount() * 9 * sizeof(float);
+}
+
+const float* CRTTriangleStream::getV0(int axis) const
+{
+	return v0[axis].data();
+}
+
+const float* CRTTriangleStream::getE1(int axis) const
+{
+	return e1[axis].data();
+}
+
+const float* CRTTriangleStream::getE2(int axis) const
+{
+	return e2[axis].data();
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <vector>
+#include "Math/CRTVector.h"
+
+// Structure-of-arrays copy of a mesh's triangles, used only for intersection.
+// Each triangle is stored as its first vertex and the two edges leaving it,
+// split into separate x/y/z arrays. The arrays are padded with degenerate
+// triangles up to a multiple of SIMD_WIDTH so a kernel can always load full lanes.
+// Triangle i of the stream is triangle i of the mesh index buffer.
+class CRTTriangleStream
+{
+public:
+	static constexpr int SIMD_WIDTH = 8;
+
+	void build(const std::vector<CRTVector>& vertices, const std::vector<int>& indices);
+	void clear();
+
+	bool isEmpty() const;
+	size_t getTriangleCount() const;
+	size_t getPaddedCount() const;
+	size_t getMemoryBytes() const;
+
+	const float* getV0(int axis) const;
+	const float* getE1(int axis) const;
+	const float* getE2(int axis) const;
+
+private:
+	std::vector<float> v0[3];
+	std::vector<float> e1[3];
+	std::vector<float> e2[3];
+	size_t triangleCount = 0;
+};
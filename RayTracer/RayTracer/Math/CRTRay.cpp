@@ -1,7 +1,8 @@
 #include "CRTRay.h"
 
-CRTRay::CRTRay(const CRTVector& origin, const CRTVector& direction, int pathDepth, CRTRayType type) 
-	: origin(origin), direction(direction), pathDepth(pathDepth), type(type)
+CRTRay::CRTRay(const CRTVector& origin, const CRTVector& direction, int pathDepth, CRTRayType type,
+			   float throughput) 
+	: origin(origin), direction(direction), pathDepth(pathDepth), type(type), throughput(throughput)
 {
 }
 
@@ -24,3 +25,8 @@ CRTRayType CRTRay::getType() const
 {
 	return type;
 }
+
+float CRTRay::getThroughput() const
+{
+	return throughput;
+}
@@ -13,17 +13,21 @@ enum class CRTRayType
 class CRTRay
 {
 public:
-	CRTRay(const CRTVector& origin, const CRTVector& direction, int pathDepth, CRTRayType type);
+	CRTRay(const CRTVector& origin, const CRTVector& direction, int pathDepth, CRTRayType type,
+		   float throughput = 1.f);
 	
 	const CRTVector& getOrigin() const;
 	const CRTVector& getDirection() const;
 	int getPathDepth() const;
 	CRTRayType getType() const;
+	// Largest weight the color returned along this ray can still have in the pixel
+	float getThroughput() const;
 
 private:
 	CRTVector origin;
 	CRTVector direction;
 	int pathDepth;
 	CRTRayType type;
+	float throughput;
 };
 
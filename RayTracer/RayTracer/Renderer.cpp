@@ -1,9 +1,19 @@
 #include "Renderer.h"
-#include <random>
 #include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <numeric>
+#include <exception>
 #include "CRTMaterial.h"
+#include "CRTTimeline.h"
+#include "CRTRandom.h"
+#include "CRTArena.h"
+#include "CRTHeapTracker.h"
+#include "CRTCameraFrame.h"
 
 template <typename T>
 T clamp(T value, T minVal, T maxVal) {
@@ -36,30 +46,98 @@ CRTVector triangleToColor(const CRTVector& p1, const CRTVector& p2, const CRTVec
     return CRTVector(r, g, b);
 }
 
-CRTVector genRandomColor() {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> distrib(0, 255);
-    return CRTVector(distrib(gen), distrib(gen), distrib(gen));
+// Random stream of the path being traced by this thread, restarted for every pixel sample
+static thread_local CRTRandom pathRandom;
+
+static void startPath(int x, int y, int sampleIndex) {
+    pathRandom = CRTRandom::forPixel(x, y, sampleIndex, 0x9a7b);
+}
+
+// Transient data of the render thread, allocations after the frame marker are dropped after every tile
+static thread_local CRTArena* threadArena = nullptr;
+
+// Last triangle that blocked each light on this thread, see Renderer::setShadowCacheEnabled
+struct OccluderCacheEntry
+{
+    int objectIdx = -1;
+    int triangleIdx = -1;
+};
+
+static thread_local CRTArenaArray<OccluderCacheEntry> occluderCache;
+
+// Shadow rays of the tile being rendered by this thread, see Renderer::setShadowBatchingEnabled
+struct ShadowBatchEntry
+{
+    CRTRay ray;
+    float maxT;
+    CRTVector contribution;
+    size_t pixelIdx;
+    uint64_t sortKey;
+    bool occluded;
+};
+
+struct ShadowBatch
+{
+    bool collecting = false;
+    size_t pixelIdx = 0;
+    CRTArenaArray<ShadowBatchEntry> entries;
+};
+
+static thread_local ShadowBatch shadowBatch;
+
+// Morton code of the direction quantized to 10 bits per axis, neighbouring directions get close keys
+static uint32_t getDirectionKey(const CRTVector& direction) {
+    uint32_t key = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        uint32_t quantized = static_cast<uint32_t>(clamp((direction.getByIndex(axis) + 1.0f) * 511.5f, 0.0f, 1023.0f));
+        for (int bit = 0; bit < 10; bit++) {
+            key |= ((quantized >> bit) & 1u) << (bit * 3 + axis);
+        }
+    }
+    return key;
 }
 
+static float getMaxComponent(const CRTVector& color) {
+    return std::max(color.getX(), std::max(color.getY(), color.getZ()));
+}
+
+// The same seed, e.g. a triangle index, always gets the same color
+CRTVector genRandomColor(uint32_t seed) {
+    CRTRandom random(seed);
+    return CRTVector(random.nextUInt() & 255, random.nextUInt() & 255, random.nextUInt() & 255);
+}
+
+
+// Region clipped to the image, empty when it does not overlap it
+static CRTRenderRegion clipRegion(const CRTRenderRegion& region, int screenWidth, int screenHeight) {
+    CRTRenderRegion clipped;
+    clipped.x0 = clamp(region.x0, 0, screenWidth);
+    clipped.y0 = clamp(region.y0, 0, screenHeight);
+    clipped.x1 = clamp(region.x1, clipped.x0, screenWidth);
+    clipped.y1 = clamp(region.y1, clipped.y0, screenHeight);
+    return clipped;
+}
 
-void writePixel(std::ofstream& ofs, const CRTVector& color) {
-    int r = clamp(floatToUint8(color.getX()), 0, 255);
-    int g = clamp(floatToUint8(color.getY()), 0, 255);
-    int b = clamp(floatToUint8(color.getZ()), 0, 255);
-    ofs << r << ' ' << g << ' ' << b << '\t';
+static CRTRenderRegion getFrameRegion(int screenWidth, int screenHeight) {
+    CRTRenderRegion region;
+    region.x1 = screenWidth;
+    region.y1 = screenHeight;
+    return region;
+}
+
+static bool isRegionEmpty(const CRTRenderRegion& region) {
+    return region.x1 <= region.x0 || region.y1 <= region.y0;
 }
 
 CRTVector Renderer::calculatePointNormal(const CRTVector& point, const CRTMesh& mesh, int idx0, int idx1, int idx2) const
 {
-    CRTVector v0Normal = mesh.getVertexNormals()[idx0];
-    CRTVector v1Normal = mesh.getVertexNormals()[idx1];
-    CRTVector v2Normal = mesh.getVertexNormals()[idx2];
+    CRTVector v0Normal = mesh.getVertexNormal(idx0);
+    CRTVector v1Normal = mesh.getVertexNormal(idx1);
+    CRTVector v2Normal = mesh.getVertexNormal(idx2);
 
-    CRTVector v0 = mesh.getVertices()[idx0];
-    CRTVector v1 = mesh.getVertices()[idx1];
-    CRTVector v2 = mesh.getVertices()[idx2];
+    CRTVector v0 = mesh.getVertex(idx0);
+    CRTVector v1 = mesh.getVertex(idx1);
+    CRTVector v2 = mesh.getVertex(idx2);
 
     CRTVector v0v2 = v2 - v0;
     CRTVector v0v1 = v1 - v0;
@@ -82,7 +160,7 @@ CRTVector Renderer::shade(const CRTRay& ray, const RayIntersectionData& data) co
 {
     CRTVector resultColorVector(0.f, 0.f, 0.f);
 
-    if (ray.getPathDepth() >= MAX_RAY_DEPTH || !data.isIntersected)
+    if (ray.getPathDepth() >= scene->getSettings().maxRayDepth || !data.isIntersected)
     {
         resultColorVector = scene->getSettings().backgroundColor;
 
@@ -117,10 +195,10 @@ CRTVector Renderer::shade(const CRTRay& ray, const RayIntersectionData& data) co
 
 CRTVector Renderer::shadeDiffuse(const CRTRay& ray, const RayIntersectionData& data) const
 {
-    const float shadowBias = 1e-2f;
-    
     CRTVector finalColor(0.f, 0.f, 0.f);
     CRTVector albedo;
+
+    CRTRenderStats* stats = CRTRenderStats::getThreadStats();
     
     if (data.material->isTexture())
     {
@@ -139,14 +217,17 @@ CRTVector Renderer::shadeDiffuse(const CRTRay& ray, const RayIntersectionData& d
         float v = cross(v0v1, v0P).length() / cross(v0v1, v0v2).length();
         float z = 1 - u - v;
 
-        CRTVector uv0 = scene->getObjects()[data.objectIdx].getUV()[data.idx0];
-        CRTVector uv1 = scene->getObjects()[data.objectIdx].getUV()[data.idx1];
-        CRTVector uv2 = scene->getObjects()[data.objectIdx].getUV()[data.idx2];
+        CRTVector uv0 = scene->getObjects()[data.objectIdx].getUV(data.idx0);
+        CRTVector uv1 = scene->getObjects()[data.objectIdx].getUV(data.idx1);
+        CRTVector uv2 = scene->getObjects()[data.objectIdx].getUV(data.idx2);
 
         CRTVector interpolatedUV = u * uv1 + v * uv2 + z * uv0;
 
         if (texture != nullptr) 
         {
+            if (stats)
+                stats->textureSamples++;
+
             if (texture->getType() == "bitmap" || texture->getType() == "checker")
             {
                 albedo = texture->getColor(interpolatedUV.getX(), interpolatedUV.getY());
@@ -172,37 +253,125 @@ CRTVector Renderer::shadeDiffuse(const CRTRay& ray, const RayIntersectionData& d
 
     CRTVector normal = data.material->isSmoothShading() ? data.intersectionPointNormal : data.intersectionTriangle.getNormal();
 
-    for (int i = 0; i < scene->getLights().size(); i++)
+    const CRTLightTree& lightTree = scene->getLightTree();
+
+    if (lightSampling.samples > 0 && !lightTree.isEmpty())
+    {
+        // Every sample is divided by its probability and by the number of samples,
+        // so the expected value is the sum over all lights
+        const float sampleWeight = 1.f / lightSampling.samples;
+
+        for (int k = 0; k < lightSampling.samples; k++)
+        {
+            float pdf = 0.f;
+            int lightIdx = lightTree.sample(data.intersectionPoint, pathRandom.nextFloat(), lightSampling.cullThreshold, pdf);
+            if (lightIdx < 0)
+                break;
+
+            finalColor = finalColor + shadeLight(ray, data, lightIdx, albedo, normal, sampleWeight / pdf);
+        }
+    }
+    else if (lightSampling.cullThreshold > 0.f)
+    {
+        lightTree.forEachLight(data.intersectionPoint, lightSampling.cullThreshold, [&](int lightIdx) {
+            finalColor = finalColor + shadeLight(ray, data, lightIdx, albedo, normal, 1.f);
+        });
+    }
+    else
     {
-        const CRTLight& light = scene->getLights()[i];
+        for (int i = 0; i < scene->getLights().size(); i++)
+        {
+            finalColor = finalColor + shadeLight(ray, data, i, albedo, normal, 1.f);
+        }
+    }
+
+    return finalColor;
+}
+
+CRTVector Renderer::shadeLight(const CRTRay& ray, const RayIntersectionData& data, int lightIdx,
+                               const CRTVector& albedo, const CRTVector& normal, float weight) const
+{
+    const float shadowBias = 1e-2f;
+
+    CRTRenderStats* stats = CRTRenderStats::getThreadStats();
+
+    const CRTLight& light = scene->getLights()[lightIdx];
 
-        CRTVector intersectionPoint = data.intersectionPoint;
-        CRTVector lightPosition = light.getPosition();
-        CRTTriangle intersectionTriangle = data.intersectionTriangle;
+    CRTVector intersectionPoint = data.intersectionPoint;
+    CRTVector lightPosition = light.getPosition();
+    CRTTriangle intersectionTriangle = data.intersectionTriangle;
 
-        CRTVector lightDir = lightPosition - intersectionPoint;
-        float sphereRadius = lightDir.length();
+    CRTVector lightDir = lightPosition - intersectionPoint;
+    float sphereRadius = lightDir.length();
 
-        float maxT = lightDir.length() - 1e-2f;
+    float maxT = lightDir.length() - 1e-2f;
 
-        lightDir.normalise();
+    lightDir.normalise();
 
-        float cosLaw = std::max(0.f, dot(lightDir, normal));
-        float sphereArea = 4 * 3.14 * sphereRadius * sphereRadius;
+    float cosLaw = std::max(0.f, dot(lightDir, normal));
+    float sphereArea = 4 * 3.14 * sphereRadius * sphereRadius;
 
-        CRTRay shadowRay(intersectionPoint + intersectionTriangle.getNormal() * shadowBias, 
-                         lightDir, ray.getPathDepth() + 1, CRTRayType::SHADOW);
+    CRTRay shadowRay(intersectionPoint + intersectionTriangle.getNormal() * shadowBias, 
+                     lightDir, ray.getPathDepth() + 1, CRTRayType::SHADOW);
 
+    // Hits of camera rays leave their shadow rays to the tile's batch, lights facing away add nothing
+    if (shadowBatch.collecting && ray.getPathDepth() == 0) {
+        if (cosLaw > 0.f) {
+            CRTVector contribution = light.getIntensity() / sphereArea * albedo * cosLaw;
+            uint64_t sortKey = (static_cast<uint64_t>(lightIdx) << 32) | getDirectionKey(lightDir);
+            shadowBatch.entries.push_back({ shadowRay, maxT, contribution * weight, shadowBatch.pixelIdx, sortKey, false });
+        }
+
+        return CRTVector(0.f, 0.f, 0.f);
+    }
+
+    bool isOccluded = false;
+
+    OccluderCacheEntry* cacheEntry = nullptr;
+    if (shadowCacheEnabled) {
+        if (occluderCache.size() != scene->getLights().size()) {
+            occluderCache.assign(scene->getLights().size(), OccluderCacheEntry());
+        }
+        cacheEntry = &occluderCache[lightIdx];
+    }
+
+    if (cacheEntry && cacheEntry->objectIdx >= 0 && cacheEntry->objectIdx < static_cast<int>(scene->getObjects().size())) {
+        const CRTTriangleStream& stream = scene->getObjects()[cacheEntry->objectIdx].getTriangleStream();
+
+        float t;
+        isOccluded = CRTTriangleKernels::intersectOne(stream, cacheEntry->triangleIdx, shadowRay, maxT, t) &&
+                     !isRefractiveHitBefore(shadowRay, t);
+
+        if (stats) {
+            stats->shadowCacheLookups++;
+            if (isOccluded) {
+                stats->shadowCacheHits++;
+                stats->raysByType[static_cast<int>(CRTRayType::SHADOW)]++;
+                stats->triangleTests++;
+            }
+        }
+    }
+
+    if (!isOccluded) {
         RayIntersectionData shadowRayData = traceRay(shadowRay, maxT);
 
-        CRTVector lightContribution = (shadowRayData.isIntersected && 
-                                      shadowRayData.material->getType() != CRTMaterialType::REFRACTIVE) ? CRTVector() :
-                                      light.getIntensity() / sphereArea * albedo * cosLaw;
+        isOccluded = shadowRayData.isIntersected &&
+                     shadowRayData.material->getType() != CRTMaterialType::REFRACTIVE;
 
-        finalColor = finalColor + lightContribution;
+        // Only blockers of meshes with a triangle stream can be tested on their own
+        if (cacheEntry && isOccluded && !scene->getObjects()[shadowRayData.objectIdx].getTriangleStream().isEmpty()) {
+            cacheEntry->objectIdx = shadowRayData.objectIdx;
+            cacheEntry->triangleIdx = shadowRayData.triangleIdx;
+        }
     }
 
-    return finalColor;
+    if (stats && isOccluded)
+        stats->shadowOcclusions++;
+
+    CRTVector lightContribution = isOccluded ? CRTVector() :
+                                  light.getIntensity() / sphereArea * albedo * cosLaw;
+
+    return lightContribution * weight;
 }
 
 CRTVector Renderer::shadeReflective(const CRTRay& ray, const RayIntersectionData& data) const
@@ -215,11 +384,10 @@ CRTVector Renderer::shadeReflective(const CRTRay& ray, const RayIntersectionData
     CRTVector reflectionRayDir = rayDir - 2 * dot(rayDir, normal) * normal;
 
     CRTRay reflectionRay(data.intersectionPoint + normal * 1e-2f, reflectionRayDir, 
-                         ray.getPathDepth() + 1, CRTRayType::REFLECTION);
-
-    RayIntersectionData reflectionRayData = traceRay(reflectionRay);
+                         ray.getPathDepth() + 1, CRTRayType::REFLECTION,
+                         ray.getThroughput() * getMaxComponent(data.material->getAlbedo()));
 
-    CRTVector finalColor = shade(reflectionRay, reflectionRayData);
+    CRTVector finalColor = traceAndShade(reflectionRay);
 
     finalColor = multiplyColors(finalColor, data.material->getAlbedo());
 
@@ -252,11 +420,9 @@ CRTVector Renderer::shadeRefractive(const CRTRay& ray, const RayIntersectionData
     {
         //Total internal reflection
         CRTRay reflectedRay(data.intersectionPoint + (N * reflectionBias), I - 2.f * dot(I, N) * N,
-            ray.getPathDepth() + 1, CRTRayType::REFLECTION);
-
-        RayIntersectionData reflectedData = traceRay(reflectedRay);
+            ray.getPathDepth() + 1, CRTRayType::REFLECTION, ray.getThroughput());
 
-        return shade(reflectedRay, reflectedData);
+        return traceAndShade(reflectedRay);
     }
 
     float sinBetha = (sinAlpha * nI) / nR;
@@ -270,28 +436,72 @@ CRTVector Renderer::shadeRefractive(const CRTRay& ray, const RayIntersectionData
 
     CRTVector R = A + B;
 
-    CRTRay refractedRay(data.intersectionPoint + ((N * -1.f) * refractionBias), R, 
-                        ray.getPathDepth() + 1, CRTRayType::REFRACTIVE);
+    float fresnel = 0.5f * (std::powf(1.f + dot(I, N), 5.f));
 
-    RayIntersectionData refractedData = traceRay(refractedRay);
+    if (singleBranchRefraction)
+    {
+        // The Fresnel weight and the probability of the branch cancel out,
+        // so the chosen ray keeps the throughput of the incoming one
+        if (pathRandom.nextFloat() < fresnel)
+        {
+            CRTRay reflectedRay(data.intersectionPoint + (N * reflectionBias), I - 2.f * dot(I, N) * N,
+                                ray.getPathDepth() + 1, CRTRayType::REFLECTION, ray.getThroughput());
 
-    CRTVector refractedColor = shade(refractedRay, refractedData);
+            return traceAndShade(reflectedRay);
+        }
 
+        CRTRay refractedRay(data.intersectionPoint + ((N * -1.f) * refractionBias), R,
+                            ray.getPathDepth() + 1, CRTRayType::REFRACTIVE, ray.getThroughput());
 
-    CRTRay reflectedRay(data.intersectionPoint + (N * reflectionBias), I - 2.f * dot(I, N) * N,
-                        ray.getPathDepth() + 1, CRTRayType::REFLECTION);
+        return traceAndShade(refractedRay);
+    }
 
-    RayIntersectionData reflectedData = traceRay(reflectedRay);
+    CRTRay refractedRay(data.intersectionPoint + ((N * -1.f) * refractionBias), R, 
+                        ray.getPathDepth() + 1, CRTRayType::REFRACTIVE, ray.getThroughput() * (1.f - fresnel));
 
-    CRTVector reflectedColor = shade(reflectedRay, reflectedData);
+    CRTVector refractedColor = traceAndShade(refractedRay);
 
 
-    float fresnel = 0.5f * (std::powf(1.f + dot(I, N), 5.f));
+    CRTRay reflectedRay(data.intersectionPoint + (N * reflectionBias), I - 2.f * dot(I, N) * N,
+                        ray.getPathDepth() + 1, CRTRayType::REFLECTION, ray.getThroughput() * fresnel);
+
+    CRTVector reflectedColor = traceAndShade(reflectedRay);
+
 
     return fresnel * reflectedColor + (1.f - fresnel) * refractedColor;
 
 }
 
+CRTVector Renderer::traceAndShade(const CRTRay& ray) const
+{
+    const CRTSettings& settings = scene->getSettings();
+
+    // Past the depth limit shade() returns the background whatever the ray hits
+    if (ray.getPathDepth() >= settings.maxRayDepth) {
+        return settings.backgroundColor;
+    }
+
+    // Russian roulette: the ray survives with probability equal to its throughput and its
+    // color is divided by that probability, so the expected pixel value does not change
+    float survival = 1.0f;
+    if (settings.russianRouletteDepth > 0 && ray.getPathDepth() >= settings.russianRouletteDepth) {
+        survival = std::min(1.0f, ray.getThroughput());
+
+        if (survival < 1.0f && pathRandom.nextFloat() >= survival) {
+            CRTRenderStats* stats = CRTRenderStats::getThreadStats();
+            if (stats)
+                stats->rouletteTerminations++;
+
+            return CRTVector(0.f, 0.f, 0.f);
+        }
+    }
+
+    RayIntersectionData data = traceRay(ray);
+    CRTVector color = shade(ray, data);
+
+    return survival < 1.0f ? color * (1.0f / survival) : color;
+}
+
 CRTVector Renderer::shadeConstant(const CRTRay& ray, const RayIntersectionData& data) const
 {
     CRTVector finalColor = data.material->getAlbedo();
@@ -301,88 +511,743 @@ CRTVector Renderer::shadeConstant(const CRTRay& ray, const RayIntersectionData&
 
 Renderer::Renderer(const CRTScene* scene) : scene(scene)
 {
+    setKernelType(CRTTriangleKernels::getBestSupported());
+}
+
+void Renderer::setKernelType(CRTKernelType type)
+{
+    kernelType = CRTTriangleKernels::isSupported(type) ? type : CRTKernelType::SCALAR;
+    triangleKernel = CRTTriangleKernels::getKernel(kernelType);
+}
+
+CRTKernelType Renderer::getKernelType() const
+{
+    return kernelType;
+}
+
+void Renderer::setThreadCount(int count)
+{
+    threadCount = std::max(0, count);
+}
+
+void Renderer::setStatsEnabled(bool enabled)
+{
+    statsEnabled = enabled;
+}
+
+void Renderer::setStatsFile(const std::string& fileName)
+{
+    statsFile = fileName;
+}
+
+void Renderer::setAdaptiveEnabled(bool enabled)
+{
+    adaptiveEnabled = enabled;
+}
+
+void Renderer::setAdaptiveSettings(const CRTAdaptiveSettings& settings)
+{
+    adaptiveSettings = settings;
+    adaptiveSettings.strataPerAxis = std::max(1, adaptiveSettings.strataPerAxis);
+    adaptiveSettings.maxRounds = std::max(1, adaptiveSettings.maxRounds);
+}
 
+void Renderer::setSingleBranchRefraction(bool enabled)
+{
+    singleBranchRefraction = enabled;
+}
+
+void Renderer::setLightSampling(const CRTLightSamplingSettings& settings)
+{
+    lightSampling = settings;
+}
+
+void Renderer::setShadowCacheEnabled(bool enabled)
+{
+    shadowCacheEnabled = enabled;
+}
+
+void Renderer::setShadowBatchingEnabled(bool enabled)
+{
+    shadowBatchingEnabled = enabled;
+}
+
+void Renderer::setSamplerType(CRTSamplerType type)
+{
+    samplerType = type;
+}
+
+void Renderer::setShutter(float fraction)
+{
+    shutter = fraction;
+}
+
+CRTSamplerType Renderer::getSamplerType() const
+{
+    return samplerType;
 }
 
 void Renderer::renderScene(const std::string& outputFile) const
+{
+    renderScene(outputFile, getFrameRegion(scene->getSettings().imageWidth, scene->getSettings().imageHeight),
+                CRTRegionOutput::CROP);
+}
+
+void Renderer::renderScene(const std::string& outputFile, const CRTRenderRegion& region, CRTRegionOutput output) const
 {
     int screenWidth = scene->getSettings().imageWidth;
     int screenHeight = scene->getSettings().imageHeight;
 
-    std::ofstream ofs(outputFile);
-    ofs << "P3\n" << screenWidth << " " << screenHeight << "\n255\n";
+    FrameOptions options;
+    options.region = clipRegion(region, screenWidth, screenHeight);
+    if (isRegionEmpty(options.region)) {
+        std::cout << "Render region is outside the " << screenWidth << "x" << screenHeight << " image" << std::endl;
+        return;
+    }
+
+    CRTRenderStats stats;
+    stats.parseSeconds = scene->getParseSeconds();
+    stats.buildSeconds = scene->getBuildSeconds();
+
+    std::vector<CRTVector> framebuffer;
+    std::vector<int> sampleCounts;
+
+    if (adaptiveEnabled) {
+        sampleCounts.assign(static_cast<size_t>(screenWidth) * screenHeight, 0);
+        options.sampleCounts = &sampleCounts;
+    }
+
+    CRT_TIMELINE_ZONE_INDEX("frame", 0);
+
+    auto traceStart = std::chrono::steady_clock::now();
+    renderFrame(scene->getCamera(), framebuffer, statsEnabled ? &stats : nullptr, options);
+    auto traceEnd = std::chrono::steady_clock::now();
+
+    writeImage(outputFile, framebuffer, screenWidth, screenHeight, options.region, output);
+    if (adaptiveEnabled) {
+        const int maxSampleCount = adaptiveSettings.strataPerAxis * adaptiveSettings.strataPerAxis * adaptiveSettings.maxRounds;
+        writeSampleCountImage(outputFile.substr(0, outputFile.find_last_of('.')) + "_spp.ppm",
+                              sampleCounts, maxSampleCount, screenWidth, screenHeight, options.region, output);
+    }
+    auto outputEnd = std::chrono::steady_clock::now();
+
+    if (statsEnabled)
+    {
+        stats.traceSeconds = std::chrono::duration<double>(traceEnd - traceStart).count();
+        stats.outputSeconds = std::chrono::duration<double>(outputEnd - traceEnd).count();
+
+        stats.print(std::cout);
+        stats.writeJson(statsFile.empty() ? outputFile + ".stats.json" : statsFile);
+    }
+}
+
+void Renderer::renderProgressive(const std::string& outputFile, const CRTProgressiveSettings& settings) const
+{
+    int screenWidth = scene->getSettings().imageWidth;
+    int screenHeight = scene->getSettings().imageHeight;
+    const size_t pixelCount = static_cast<size_t>(screenWidth) * screenHeight;
+
+    CRTRenderStats stats;
+    stats.parseSeconds = scene->getParseSeconds();
+    stats.buildSeconds = scene->getBuildSeconds();
+
+    std::vector<CRTVector> framebuffer;
+    std::vector<CRTVector> accumulation(pixelCount);
+    std::vector<int> sampleCounts(pixelCount, 0);
+
+    // Without any stopping rule a single pass is rendered
+    const int maxSamples = (settings.maxSamples > 0 || settings.timeBudgetSeconds > 0.f) ? settings.maxSamples : 1;
+
+    const auto start = std::chrono::steady_clock::now();
+    auto lastSnapshot = start;
 
-    for (int j = 0; j < screenHeight; j++) {
+    FrameOptions options;
+    options.printProgress = false;
+    options.accumulation = &accumulation;
+    options.sampleCounts = &sampleCounts;
+    if (settings.timeBudgetSeconds > 0.f) {
+        options.deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<float>(settings.timeBudgetSeconds));
+    }
+
+    auto writeAverage = [&]() {
+        for (size_t i = 0; i < pixelCount; i++) {
+            framebuffer[i] = sampleCounts[i] > 0 ? accumulation[i] * (1.0f / sampleCounts[i]) : CRTVector(0.f, 0.f, 0.f);
+        }
+        writeImage(outputFile, framebuffer, screenWidth, screenHeight);
+    };
 
-        if (j % (screenHeight / 100) == 0)
-            std::cout << (j / (screenHeight / 100)) << "%\n";
+    int passes = 0;
+    double outputSeconds = 0.0;
 
-        for (int i = 0; i < screenWidth; i++) {
+    for (int sample = 0; maxSamples <= 0 || sample < maxSamples; sample++) {
+        CRT_TIMELINE_ZONE_INDEX("pass", sample);
 
-            CRTRay ray = genRay(i, j, scene->getCamera(), screenWidth, screenHeight);
-            
-            RayIntersectionData data = traceRay(ray);
+        options.sampleIndex = sample;
+        renderFrame(scene->getCamera(), framebuffer, statsEnabled ? &stats : nullptr, options);
+        passes++;
 
-            CRTVector finalColor = shade(ray, data);
+        auto passEnd = std::chrono::steady_clock::now();
+        if (passEnd >= options.deadline) {
+            break;
+        }
+
+        bool lastPass = maxSamples > 0 && sample + 1 == maxSamples;
+        if (!lastPass && settings.snapshotSeconds > 0.f &&
+            std::chrono::duration<float>(passEnd - lastSnapshot).count() >= settings.snapshotSeconds) {
+            writeAverage();
+            lastSnapshot = std::chrono::steady_clock::now();
+            outputSeconds += std::chrono::duration<double>(lastSnapshot - passEnd).count();
 
-            writePixel(ofs, finalColor);    
+            std::cout << "Snapshot after " << passes << " samples per pixel" << std::endl;
         }
-        ofs << "\n";
     }
-    std::cout << "100%\n";
-    ofs.close();
+
+    auto traceEnd = std::chrono::steady_clock::now();
+    writeAverage();
+    if (adaptiveEnabled) {
+        const int maxSampleCount = adaptiveSettings.strataPerAxis * adaptiveSettings.strataPerAxis * adaptiveSettings.maxRounds;
+        writeSampleCountImage(outputFile.substr(0, outputFile.find_last_of('.')) + "_spp.ppm",
+                              sampleCounts, maxSampleCount * passes, screenWidth, screenHeight,
+                              getFrameRegion(screenWidth, screenHeight), CRTRegionOutput::CROP);
+    }
+    auto outputEnd = std::chrono::steady_clock::now();
+
+    auto minMax = std::minmax_element(sampleCounts.begin(), sampleCounts.end());
+    std::cout << "Progressive render: " << passes << " passes, " << *minMax.first << " - " << *minMax.second
+              << " samples per pixel in " << std::chrono::duration<double>(outputEnd - start).count() << " s" << std::endl;
+
+    if (statsEnabled)
+    {
+        stats.traceSeconds = std::chrono::duration<double>(traceEnd - start).count() - outputSeconds;
+        stats.outputSeconds = outputSeconds + std::chrono::duration<double>(outputEnd - traceEnd).count();
+
+        stats.print(std::cout);
+        stats.writeJson(statsFile.empty() ? outputFile + ".stats.json" : statsFile);
+    }
+}
+
+void Renderer::renderHeatmap(const std::string& outputFileBaseName) const
+{
+    CRTRenderStats stats;
+    stats.parseSeconds = scene->getParseSeconds();
+    stats.buildSeconds = scene->getBuildSeconds();
+
+    std::vector<CRTVector> framebuffer;
+    CRTHeatmap heatmap;
+
+    FrameOptions options;
+    options.heatmap = &heatmap;
+
+    CRT_TIMELINE_ZONE_INDEX("frame", 0);
+
+    auto traceStart = std::chrono::steady_clock::now();
+    renderFrame(scene->getCamera(), framebuffer, &stats, options);
+    auto traceEnd = std::chrono::steady_clock::now();
+
+    heatmap.writeImages(outputFileBaseName);
+    heatmap.writeRaw(outputFileBaseName + ".heatmap.raw");
+    auto outputEnd = std::chrono::steady_clock::now();
+
+    stats.traceSeconds = std::chrono::duration<double>(traceEnd - traceStart).count();
+    stats.outputSeconds = std::chrono::duration<double>(outputEnd - traceEnd).count();
+
+    for (int c = 0; c < CRTHeatmap::CHANNEL_COUNT; c++) {
+        CRTHeatmap::Channel channel = static_cast<CRTHeatmap::Channel>(c);
+        std::cout << "Heatmap " << CRTHeatmap::getChannelName(channel)
+                  << " max per pixel: " << heatmap.getMaxValue(channel) << std::endl;
+    }
+
+    if (statsEnabled)
+    {
+        stats.print(std::cout);
+        stats.writeJson(statsFile.empty() ? outputFileBaseName + ".stats.json" : statsFile);
+    }
 }
 
 void Renderer::renderAnimation(const std::string& outputFileBaseName) const
+{
+    renderAnimation(outputFileBaseName, 0, ANIMATION_FRAME_COUNT);
+}
+
+void Renderer::renderAnimation(const std::string& outputFileBaseName, int firstFrame, int frameCount) const
 {
     int screenWidth = scene->getSettings().imageWidth;
     int screenHeight = scene->getSettings().imageHeight;
 
-    for (int k = 0; k < 16; k++) 
+    CRTRenderStats stats;
+    stats.parseSeconds = scene->getParseSeconds();
+    stats.buildSeconds = scene->getBuildSeconds();
+
+    std::vector<CRTVector> framebuffer;
+
+    const int endFrame = std::min(firstFrame + frameCount, ANIMATION_FRAME_COUNT);
+    for (int k = std::max(firstFrame, 0); k < endFrame; k++) 
+    {
+        CRT_TIMELINE_ZONE_INDEX("frame", k);
+
+        auto traceStart = std::chrono::steady_clock::now();
+        renderFrame(getAnimationCamera(k), framebuffer, statsEnabled ? &stats : nullptr, FrameOptions());
+        auto traceEnd = std::chrono::steady_clock::now();
+
+        writeImage(outputFileBaseName + std::to_string(k) + ".ppm", framebuffer, screenWidth, screenHeight);
+        auto outputEnd = std::chrono::steady_clock::now();
+
+        stats.traceSeconds += std::chrono::duration<double>(traceEnd - traceStart).count();
+        stats.outputSeconds += std::chrono::duration<double>(outputEnd - traceEnd).count();
+    }
+
+    if (statsEnabled)
     {
-        CRTCamera camera = scene->getCamera();
-        camera.panAroundTarget(k * 20, CRTVector(0.f, -5.f, 0.f));
+        stats.print(std::cout);
+        stats.writeJson(statsFile.empty() ? outputFileBaseName + ".stats.json" : statsFile);
+    }
+}
+
+void Renderer::renderFrame(const CRTCamera& camera, std::vector<CRTVector>& framebuffer, CRTRenderStats* stats,
+                           const FrameOptions& options) const
+{
+    int screenWidth = scene->getSettings().imageWidth;
+    int screenHeight = scene->getSettings().imageHeight;
+
+    framebuffer.resize(static_cast<size_t>(screenWidth) * screenHeight);
+    if (options.heatmap) {
+        options.heatmap->resize(screenWidth, screenHeight);
+    }
+
+    const CRTRenderRegion region = isRegionEmpty(options.region) ? getFrameRegion(screenWidth, screenHeight)
+                                                                 : options.region;
+
+    const std::vector<CRTCameraFrame> shutterFrames = getShutterFrames(camera);
+    FrameOptions tileOptions = options;
+    tileOptions.shutterFrames = shutterFrames.empty() ? nullptr : &shutterFrames;
+
+    // The tile grid starts at the corner of the region, a pixel renders the same in any tile
+    const int tilesX = (region.x1 - region.x0 + TILE_SIZE - 1) / TILE_SIZE;
+    const int tilesY = (region.y1 - region.y0 + TILE_SIZE - 1) / TILE_SIZE;
+    const int tileCount = tilesX * tilesY;
+
+    const int workerCount = threadCount > 0 ? threadCount : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+    // Tiles are handed out in order through a shared counter, each worker keeps its own stats
+    std::vector<CRTRenderStats> workerStats(workerCount);
+    std::atomic<int> nextTile(0);
+    std::atomic<int> tilesDone(0);
+    std::mutex progressMutex;
+    std::exception_ptr workerError;
+
+    auto worker = [&](int workerIdx) {
+        CRTRenderStats::setThreadStats(stats ? &workerStats[workerIdx] : nullptr);
+
+        // Data of the whole frame goes below the marker, what a tile allocates above it is dropped after the tile
+        CRTArena arena;
+        threadArena = &arena;
+        occluderCache.init(&arena, scene->getLights().size());
+        occluderCache.assign(scene->getLights().size(), OccluderCacheEntry());
+        const CRTArena::Marker frameMarker = arena.getMarker();
+
+        try {
+            // The deadline is checked before taking a tile, so every tile taken gets rendered
+            while (std::chrono::steady_clock::now() < options.deadline) {
+                int tile = nextTile++;
+                if (tile >= tileCount) {
+                    break;
+                }
+
+                CRT_TIMELINE_ZONE_INDEX("tile", tile);
+
+                int x0 = region.x0 + (tile % tilesX) * TILE_SIZE;
+                int y0 = region.y0 + (tile / tilesX) * TILE_SIZE;
+
+                const long long heapAllocations = CRTHeapTracker::getThreadAllocations();
+
+                renderTile(camera, framebuffer, x0, y0,
+                           std::min(x0 + TILE_SIZE, region.x1), std::min(y0 + TILE_SIZE, region.y1), tileOptions);
+                arena.resetTo(frameMarker);
+
+                if (stats) {
+                    workerStats[workerIdx].tileHeapAllocations += CRTHeapTracker::getThreadAllocations() - heapAllocations;
+                }
+
+                int done = ++tilesDone;
+                if (options.printProgress && done * 100 / tileCount != (done - 1) * 100 / tileCount) {
+                    std::lock_guard<std::mutex> lock(progressMutex);
+                    std::cout << (done * 100 / tileCount) << "%\n";
+                }
+            }
+        } catch (...) {
+            // The first failure is rethrown once every worker stopped, the others take no new tiles
+            std::lock_guard<std::mutex> lock(progressMutex);
+            if (!workerError) {
+                workerError = std::current_exception();
+            }
+            nextTile = tileCount;
+        }
+
+        occluderCache.init(nullptr, 0);
+        shadowBatch.entries.init(nullptr, 0);
+        threadArena = nullptr;
+        CRTRenderStats::setThreadStats(nullptr);
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < workerCount; i++) {
+        threads.emplace_back(worker, i);
+    }
+
+    worker(0);
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    if (workerError) {
+        std::rethrow_exception(workerError);
+    }
 
-        std::ofstream ofs(outputFileBaseName + std::to_string(k) + ".ppm");
+    if (stats) {
+        for (const CRTRenderStats& threadStats : workerStats) {
+            stats->merge(threadStats);
+        }
+    }
+}
+
+void Renderer::renderTile(const CRTCamera& camera, std::vector<CRTVector>& framebuffer,
+                          int x0, int y0, int x1, int y1, const FrameOptions& options) const
+{
+    int screenWidth = scene->getSettings().imageWidth;
+    int screenHeight = scene->getSettings().imageHeight;
+
+    CRTHeatmap* heatmap = options.heatmap;
+
+    int sampleCount = 1;
+
+    CRTRenderStats* threadStats = CRTRenderStats::getThreadStats();
+
+    const bool batchShadows = shadowBatchingEnabled && !adaptiveEnabled && !heatmap;
+    shadowBatch.collecting = batchShadows;
+    if (batchShadows) {
+        shadowBatch.entries.init(threadArena, static_cast<size_t>(x1 - x0) * (y1 - y0));
+    }
 
-        ofs << "P3\n" << screenWidth << " " << screenHeight << "\n255\n";
+    auto accumulate = [&](size_t pixelIdx, int sampleCount) {
+        if (options.accumulation) {
+            (*options.accumulation)[pixelIdx] = (*options.accumulation)[pixelIdx] + framebuffer[pixelIdx] * static_cast<float>(sampleCount);
+        }
+        if (options.sampleCounts) {
+            (*options.sampleCounts)[pixelIdx] += sampleCount;
+        }
+    };
+
+    // Camera rays of a whole tile row are generated together, the adaptive path makes its own.
+    // Lenses and moving cameras need the sampler for every ray.
+    const CRTCameraFrame cameraFrame(camera, screenWidth, screenHeight);
+    const bool pinhole = !cameraFrame.hasLens() && !camera.isMoving();
+    const int rowWidth = x1 - x0;
+    float* rowSampleX = threadArena->allocateArray<float>(rowWidth);
+    float* rowSampleY = threadArena->allocateArray<float>(rowWidth);
+    float* rowDirX = threadArena->allocateArray<float>(rowWidth);
+    float* rowDirY = threadArena->allocateArray<float>(rowWidth);
+    float* rowDirZ = threadArena->allocateArray<float>(rowWidth);
+    CRTCameraSample* rowCameraSamples = pinhole ? nullptr : threadArena->allocateArray<CRTCameraSample>(rowWidth);
+
+    for (int j = y0; j < y1; j++) {
+        if (!adaptiveEnabled) {
+            // Sample 0 is the pixel centre, the following ones come from the sampler
+            for (int i = x0; i < x1; i++) {
+                rowSampleX[i - x0] = 0.5f;
+                rowSampleY[i - x0] = 0.5f;
+                if (!pinhole) {
+                    rowCameraSamples[i - x0] = CRTCameraSample();
+                }
+                if (options.sampleIndex > 0) {
+                    CRTSampler sampler(samplerType, i, j);
+                    sampler.startSample(options.sampleIndex);
+                    sampler.get2D(rowSampleX[i - x0], rowSampleY[i - x0]);
+                    if (!pinhole) {
+                        rowCameraSamples[i - x0].draw(sampler);
+                    }
+                }
+            }
+            if (pinhole) {
+                cameraFrame.getRowDirections(j, x0, x1, rowSampleX, rowSampleY, rowDirX, rowDirY, rowDirZ);
+            }
+        }
 
-        for (int j = 0; j < screenHeight; j++) {
+        for (int i = x0; i < x1; i++) {
 
-            if (j % (screenHeight / 100) == 0)
-                std::cout << (j / (screenHeight / 100)) << "%\n";
+            // For the heatmap the counters of this pixel are collected on their own
+            // and folded into the thread's stats afterwards
+            CRTRenderStats pixelStats;
+            if (heatmap) {
+                CRTRenderStats::setThreadStats(&pixelStats);
+            }
 
-            for (int i = 0; i < screenWidth; i++) {
+            size_t pixelIdx = static_cast<size_t>(j) * screenWidth + i;
+
+            if (adaptiveEnabled) {
+                framebuffer[pixelIdx] = samplePixelAdaptive(i, j, camera, options.sampleIndex, options.shutterFrames,
+                                                            sampleCount);
+            }
+            else {
+                startPath(i, j, options.sampleIndex);
 
-                CRTRay ray = genRay(i, j, camera, screenWidth, screenHeight);
+                CRTRay ray = pinhole ?
+                    CRTRay(cameraFrame.getOrigin(), CRTVector(rowDirX[i - x0], rowDirY[i - x0], rowDirZ[i - x0]),
+                           0, CRTRayType::CAMERA) :
+                    genLensRay(i + rowSampleX[i - x0], j + rowSampleY[i - x0], rowCameraSamples[i - x0], cameraFrame,
+                               options.shutterFrames);
 
                 RayIntersectionData data = traceRay(ray);
 
-                CRTVector finalColor = shade(ray, data);
+                shadowBatch.pixelIdx = pixelIdx;
+                framebuffer[pixelIdx] = shade(ray, data);
+            }
+
+            // With batching the pixels are complete only after the batch is traced
+            if (!batchShadows) {
+                accumulate(pixelIdx, sampleCount);
+            }
 
-                writePixel(ofs, finalColor);
+            if (heatmap) {
+                CRTRenderStats::setThreadStats(threadStats);
+                if (threadStats) {
+                    threadStats->merge(pixelStats);
+                }
+                heatmap->record(i, j, pixelStats);
             }
-            ofs << "\n";
         }
-        std::cout << "100%\n";
-        ofs.close();
-        
     }
+
+    if (batchShadows) {
+        shadowBatch.collecting = false;
+        traceShadowBatch(framebuffer);
+
+        for (int j = y0; j < y1; j++) {
+            for (int i = x0; i < x1; i++) {
+                accumulate(static_cast<size_t>(j) * screenWidth + i, 1);
+            }
+        }
+    }
+}
+
+void Renderer::traceShadowBatch(std::vector<CRTVector>& framebuffer) const
+{
+    CRT_TIMELINE_ZONE("shadow batch");
+
+    CRTArenaArray<ShadowBatchEntry>& entries = shadowBatch.entries;
+
+    int* order = threadArena->allocateArray<int>(entries.size());
+    std::iota(order, order + entries.size(), 0);
+    std::sort(order, order + entries.size(), [&](int lhs, int rhs) {
+        return entries[lhs].sortKey < entries[rhs].sortKey;
+    });
+
+    CRTRenderStats* stats = CRTRenderStats::getThreadStats();
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        ShadowBatchEntry& entry = entries[order[i]];
+        entry.occluded = isOccluded(entry.ray, entry.maxT);
+
+        if (stats && entry.occluded)
+            stats->shadowOcclusions++;
+    }
+
+    // Resolved in the order the rays were queued, which is the order shadeDiffuse sums the lights in
+    for (const ShadowBatchEntry& entry : entries) {
+        if (!entry.occluded) {
+            framebuffer[entry.pixelIdx] = framebuffer[entry.pixelIdx] + entry.contribution;
+        }
+    }
+
+    entries.clear();
+}
+
+void Renderer::writeImage(const std::string& outputFile, const std::vector<CRTVector>& framebuffer,
+                          int screenWidth, int screenHeight) const
+{
+    writeImage(outputFile, framebuffer, screenWidth, screenHeight, getFrameRegion(screenWidth, screenHeight),
+               CRTRegionOutput::CROP);
+}
+
+void Renderer::writeImage(const std::string& outputFile, const std::vector<CRTVector>& framebuffer,
+                          int screenWidth, int screenHeight, const CRTRenderRegion& region, CRTRegionOutput output) const
+{
+    CRT_TIMELINE_ZONE("write image");
+
+    CRTImage crop(region.x1 - region.x0, region.y1 - region.y0);
+    for (int j = region.y0; j < region.y1; j++) {
+        for (int i = region.x0; i < region.x1; i++) {
+            const CRTVector& color = framebuffer[static_cast<size_t>(j) * screenWidth + i];
+            crop.setPixel(i - region.x0, j - region.y0,
+                          floatToUint8(color.getX()), floatToUint8(color.getY()), floatToUint8(color.getZ()));
+        }
+    }
+
+    if (output == CRTRegionOutput::CROP) {
+        if (!crop.write(outputFile)) {
+            throw std::exception("Failed to write the image");
+        }
+        return;
+    }
+
+    CRTImage image;
+    if (!image.read(outputFile) || image.getWidth() != screenWidth || image.getHeight() != screenHeight) {
+        image = CRTImage(screenWidth, screenHeight);
+    }
+
+    image.paste(crop, region.x0, region.y0);
+    if (!image.write(outputFile)) {
+        throw std::exception("Failed to write the image");
+    }
+}
+
+void Renderer::writeSampleCountImage(const std::string& outputFile, const std::vector<int>& sampleCounts,
+                                     int maxSampleCount, int screenWidth, int screenHeight, const CRTRenderRegion& region,
+                                     CRTRegionOutput output) const
+{
+    std::vector<CRTVector> image(sampleCounts.size());
+    for (size_t i = 0; i < sampleCounts.size(); i++) {
+        image[i] = CRTHeatmap::mapColor(static_cast<float>(sampleCounts[i]) / maxSampleCount);
+    }
+
+    writeImage(outputFile, image, screenWidth, screenHeight, region, output);
+}
+
+CRTVector Renderer::samplePixelAdaptive(int x, int y, const CRTCamera& camera, int sampleIndex,
+                                        const std::vector<CRTCameraFrame>* shutterFrames, int& sampleCount) const
+{
+    int screenWidth = scene->getSettings().imageWidth;
+    int screenHeight = scene->getSettings().imageHeight;
+
+    const int strata = adaptiveSettings.strataPerAxis;
+    const int maxRounds = adaptiveSettings.maxRounds;
+    const float invStrata = 1.0f / strata;
+    const float maxVariance = adaptiveSettings.errorThreshold * adaptiveSettings.errorThreshold;
+
+    CRTSampler sampler(samplerType, x, y);
+    const CRTCameraFrame cameraFrame(camera, screenWidth, screenHeight);
+    const bool pinhole = !cameraFrame.hasLens() && !camera.isMoving();
+
+    CRTVector sum(0.f, 0.f, 0.f);
+    float luminanceSum = 0.0f;
+    float luminanceSqSum = 0.0f;
+    int count = 0;
+
+    for (int round = 0; round < maxRounds; round++) {
+        // One sample per stratum, all strata shifted by the same offset. Round 0 of pass 0
+        // samples the strata centres, the rest take their offset from the sampler
+        int offsetIdx = sampleIndex * maxRounds + round;
+        float offsetX = 0.5f;
+        float offsetY = 0.5f;
+        if (offsetIdx > 0) {
+            sampler.startSample(offsetIdx);
+            sampler.get2D(offsetX, offsetY);
+        }
+
+        for (int sy = 0; sy < strata; sy++) {
+            for (int sx = 0; sx < strata; sx++) {
+                const int pathIdx = (offsetIdx * strata + sy) * strata + sx;
+                startPath(x, y, pathIdx);
+
+                const float px = x + (sx + offsetX) * invStrata;
+                const float py = y + (sy + offsetY) * invStrata;
+
+                // Every stratum sample has a lens point and time of its own, the in-pixel
+                // dimensions of its sample are skipped as the strata place it
+                CRTCameraSample cameraSample;
+                if (!pinhole && pathIdx > 0) {
+                    float unusedX, unusedY;
+                    sampler.startSample(pathIdx);
+                    sampler.get2D(unusedX, unusedY);
+                    cameraSample.draw(sampler);
+                }
+
+                CRTRay ray = pinhole ?
+                    CRTRay(cameraFrame.getOrigin(), cameraFrame.getDirection(px, py), 0, CRTRayType::CAMERA) :
+                    genLensRay(px, py, cameraSample, cameraFrame, shutterFrames);
+                CRTVector color = shade(ray, traceRay(ray));
+                sum = sum + color;
+
+                // Variance of what ends up on screen, so overexposed samples count as white
+                float luminance = 0.2126f * clamp(color.getX(), 0.0f, 1.0f) +
+                                  0.7152f * clamp(color.getY(), 0.0f, 1.0f) +
+                                  0.0722f * clamp(color.getZ(), 0.0f, 1.0f);
+                luminanceSum += luminance;
+                luminanceSqSum += luminance * luminance;
+                count++;
+            }
+        }
+
+        // Standard error of the mean luminance. A single sample says nothing about the variance,
+        // so with one stratum the second round always runs.
+        float mean = luminanceSum / count;
+        float variance = std::max(0.0f, luminanceSqSum / count - mean * mean);
+        if (count >= 2 && variance / count <= maxVariance) {
+            break;
+        }
+    }
+
+    sampleCount = count;
+    return sum * (1.0f / count);
+}
+
+CRTRay Renderer::genRay(int x, int y, const CRTCamera& camera, int imageWidth, int imageHeight,
+                        float sampleX, float sampleY) const
+{
+    CRTCameraFrame frame(camera, imageWidth, imageHeight);
+    return CRTRay(frame.getOrigin(), frame.getDirection(x + sampleX, y + sampleY), 0, CRTRayType::CAMERA);
+}
+
+CRTRay Renderer::genLensRay(float px, float py, const CRTCameraSample& sample, const CRTCameraFrame& frame,
+                            const std::vector<CRTCameraFrame>* shutterFrames) const
+{
+    CRTVector origin;
+    CRTVector direction;
+    if (shutterFrames) {
+        const float position = sample.time * SHUTTER_STEPS;
+        const int step = std::min(static_cast<int>(position), SHUTTER_STEPS - 1);
+        const CRTCameraFrame movedFrame = CRTCameraFrame::interpolate((*shutterFrames)[step], (*shutterFrames)[step + 1],
+                                                                      position - step);
+        movedFrame.getLensRay(px, py, sample.lensU, sample.lensV, origin, direction);
+    }
+    else {
+        frame.getLensRay(px, py, sample.lensU, sample.lensV, origin, direction);
+    }
+
+    return CRTRay(origin, direction, 0, CRTRayType::CAMERA);
 }
 
-CRTRay Renderer::genRay(int x, int y, const CRTCamera& camera, int imageWidth, int imageHeight) const
+CRTCamera Renderer::getAnimationCamera(int frame) const
 {
-    float xF = (x + 0.5f) / imageWidth;
-    float yF = (y + 0.5f) / imageHeight;
+    const CRTVector target(0.f, -5.f, 0.f);
+    CRTCamera camera = scene->getCamera();
+    camera.panAroundTarget(frame * ANIMATION_FRAME_DEGREES, target);
+    if (shutter > 0.f) {
+        // The shutter interval is centred on the frame, so its middle is the pose without a shutter
+        camera.panAroundTarget(-0.5f * shutter * ANIMATION_FRAME_DEGREES, target);
+        camera.openShutter();
+        camera.panAroundTarget(shutter * ANIMATION_FRAME_DEGREES, target);
+        camera.closeShutter();
+    }
 
-    xF = 2.0f * xF - 1.0f;
-    yF = 1.0f - 2.0f * yF;
-    xF *= (float)imageWidth / imageHeight;
+    return camera;
+}
 
-    CRTVector direction(xF, yF, -1.0f);
-    direction = direction * camera.getRotationMatrix();
-    direction.normalise();
-    return CRTRay(camera.getPosition(), direction, 0, CRTRayType::CAMERA);
+std::vector<CRTCameraFrame> Renderer::getShutterFrames(const CRTCamera& camera) const
+{
+    std::vector<CRTCameraFrame> frames;
+    if (!camera.isMoving()) {
+        return frames;
+    }
+
+    frames.reserve(SHUTTER_STEPS + 1);
+    for (int step = 0; step <= SHUTTER_STEPS; step++) {
+        frames.emplace_back(camera, scene->getSettings().imageWidth, scene->getSettings().imageHeight,
+                            static_cast<float>(step) / SHUTTER_STEPS);
+    }
+
+    return frames;
 }
 
 bool Renderer::isPointInTriangle(const CRTVector& point, const CRTTriangle& triangle) const
@@ -413,28 +1278,133 @@ bool Renderer::isPointInTriangle(const CRTVector& point, const CRTTriangle& tria
     return true;
 }
 
+int Renderer::intersectMesh(const CRTMesh& mesh, const CRTRay& ray, float maxT, float& closestT, bool anyHit,
+                            CRTRenderStats* stats) const
+{
+    const CRTTriangleStream& stream = mesh.getTriangleStream();
+    const CRTBVH& bvh = mesh.getBVH();
+
+    if (bvh.isEmpty()) {
+        if (stats)
+            stats->triangleTests += stream.getTriangleCount();
+        return triangleKernel(stream, ray, maxT, closestT);
+    }
+
+    long long boxTests = 0;
+    long long triangleTests = 0;
+    const int triangleIdx = bvh.intersect(stream, ray, maxT, closestT, anyHit, boxTests, triangleTests);
+
+    if (stats) {
+        stats->boxTests += boxTests;
+        stats->triangleTests += triangleTests;
+    }
+
+    return triangleIdx;
+}
+
+bool Renderer::isOccluded(const CRTRay& ray, float maxT) const
+{
+    CRTRenderStats* stats = CRTRenderStats::getThreadStats();
+    if (stats) {
+        stats->raysByType[static_cast<int>(ray.getType())]++;
+        stats->maxDepth = std::max(stats->maxDepth, ray.getPathDepth());
+    }
+
+    for (const CRTMesh& object : scene->getObjects()) {
+        // Glass lets the light through, the parser gives every mesh its triangle stream
+        const CRTTriangleStream& stream = object.getTriangleStream();
+        if (stream.isEmpty() ||
+            scene->getMaterials()[object.getMaterialIndex()].getType() == CRTMaterialType::REFRACTIVE)
+            continue;
+
+        float closestT = std::numeric_limits<float>::infinity();
+        if (intersectMesh(object, ray, maxT, closestT, true, stats) >= 0) {
+            // With glass in front of the blocker the closest hit decides, like for inline shadow rays
+            if (isRefractiveHitBefore(ray, closestT)) {
+                RayIntersectionData data = traceRay(ray, maxT);
+                return data.isIntersected && data.material->getType() != CRTMaterialType::REFRACTIVE;
+            }
+
+            if (stats)
+                stats->hits++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool Renderer::isRefractiveHitBefore(const CRTRay& ray, float t) const
+{
+    CRTRenderStats* stats = CRTRenderStats::getThreadStats();
+
+    for (const CRTMesh& object : scene->getObjects()) {
+        const CRTTriangleStream& stream = object.getTriangleStream();
+        if (stream.isEmpty() ||
+            scene->getMaterials()[object.getMaterialIndex()].getType() != CRTMaterialType::REFRACTIVE)
+            continue;
+
+        float closestT = std::numeric_limits<float>::infinity();
+        if (intersectMesh(object, ray, t, closestT, true, stats) >= 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 RayIntersectionData Renderer::traceRay(const CRTRay& ray, float maxT) const
 {
     MinData minData;
     minData.t = -1.0f;
-    
+
+    CRTRenderStats* stats = CRTRenderStats::getThreadStats();
+    if (stats) {
+        stats->raysByType[static_cast<int>(ray.getType())]++;
+        stats->maxDepth = std::max(stats->maxDepth, ray.getPathDepth());
+    }
+
     for (size_t i = 0; i < scene->getObjects().size(); i++) {
         const auto& object = scene->getObjects()[i];
-        const auto& vertices = object.getVertices();
-        const auto& indices = object.getIndices();
+        const size_t vertexCount = object.getVertexCount();
+        const size_t indexCount = object.getIndexCount();
+
+        const CRTTriangleStream& stream = object.getTriangleStream();
+
+        if (!stream.isEmpty()) {
+            float closestT = minData.t < 0 ? std::numeric_limits<float>::infinity() : minData.t;
+
+            int triangleIdx = intersectMesh(object, ray, maxT, closestT, false, stats);
+
+            if (triangleIdx >= 0) {
+                minData.t = closestT;
+                minData.idx0 = object.getIndex(triangleIdx * 3);
+                minData.idx1 = object.getIndex(triangleIdx * 3 + 1);
+                minData.idx2 = object.getIndex(triangleIdx * 3 + 2);
+                minData.triangle = CRTTriangle(object.getVertex(minData.idx0), object.getVertex(minData.idx1),
+                                               object.getVertex(minData.idx2));
+                minData.mesh = &object;
+                minData.objectIdx = i;
+                minData.triangleIdx = triangleIdx;
+            }
+            continue;
+        }
 
-        for (size_t j = 0; j + 2 < indices.size(); j += 3) {
-            size_t idx0 = indices[j];
-            size_t idx1 = indices[j + 1];
-            size_t idx2 = indices[j + 2];
+        if (stats)
+            stats->triangleTests += indexCount / 3;
+
+        for (size_t j = 0; j + 2 < indexCount; j += 3) {
+            size_t idx0 = object.getIndex(j);
+            size_t idx1 = object.getIndex(j + 1);
+            size_t idx2 = object.getIndex(j + 2);
 
             // Bounds check
-            if (idx0 >= vertices.size() || idx1 >= vertices.size() || idx2 >= vertices.size())
+            if (idx0 >= vertexCount || idx1 >= vertexCount || idx2 >= vertexCount)
                 continue;
 
-            CRTVector v0 = vertices[idx0];
-            CRTVector v1 = vertices[idx1];
-            CRTVector v2 = vertices[idx2];
+            CRTVector v0 = object.getVertex(idx0);
+            CRTVector v1 = object.getVertex(idx1);
+            CRTVector v2 = object.getVertex(idx2);
 
             // Degenerate triangle check
             if ((v1 - v0).length() < 1e-6f || (v2 - v1).length() < 1e-6f || (v0 - v2).length() < 1e-6f)
@@ -467,6 +1437,7 @@ RayIntersectionData Renderer::traceRay(const CRTRay& ray, float maxT) const
                     minData.idx1 = idx1;
                     minData.idx2 = idx2;
                     minData.objectIdx = i;
+                    minData.triangleIdx = static_cast<int>(j / 3);
                 }
             }
         }
@@ -477,6 +1448,9 @@ RayIntersectionData Renderer::traceRay(const CRTRay& ray, float maxT) const
         return { false, CRTVector(), minData.triangle};
     }
 
+    if (stats)
+        stats->hits++;
+
     CRTVector intersectionPoint = ray.getOrigin() + minData.t * ray.getDirection();
 
     CRTVector pointNormal = calculatePointNormal(intersectionPoint, *minData.mesh,
@@ -486,6 +1460,6 @@ RayIntersectionData Renderer::traceRay(const CRTRay& ray, float maxT) const
     RayIntersectionData toReturn;
     
     return { true, intersectionPoint, minData.triangle, pointNormal, material,
-             minData.idx0, minData.idx1, minData.idx2, minData.objectIdx};
+             minData.idx0, minData.idx1, minData.idx2, minData.objectIdx, CRTVector(), minData.triangleIdx};
 }
 
@@ -1,8 +1,15 @@
 #pragma once
 #include <string>
+#include <chrono>
 #include "CRTScene.h"
 #include "Math/CRTRay.h"
 #include "Math/CRTTriangle.h"
+#include "CRTTriangleKernels.h"
+#include "CRTRenderStats.h"
+#include "CRTHeatmap.h"
+#include "CRTSampler.h"
+#include "CRTImage.h"
+#include "CRTCameraFrame.h"
 
 struct RayIntersectionData
 {
@@ -28,30 +35,255 @@ struct MinData
 	int idx2;
 	const CRTMesh* mesh = nullptr;
 	int objectIdx = -1;
+	int triangleIdx = -1;
+};
+
+// Lens point and shutter time of a camera ray, both in [0, 1). The defaults, which sample 0 of a pixel
+// keeps, go through the lens centre in the middle of the shutter interval.
+struct CRTCameraSample
+{
+	float lensU = 0.5f;
+	float lensV = 0.5f;
+	float time = 0.5f;
+
+	// Dimensions 2 to 4 of the sampler's current sample, after the position in the pixel
+	void draw(CRTSampler& sampler)
+	{
+		sampler.get2D(lensU, lensV);
+		time = sampler.get1D();
+	}
+};
+
+// Stopping and snapshot rules of renderProgressive, 0 disables a rule
+struct CRTProgressiveSettings
+{
+	int maxSamples = 64;
+	float timeBudgetSeconds = 0.f;
+	float snapshotSeconds = 5.f;
+};
+
+// Stratified adaptive anti-aliasing. Every pixel gets rounds of strataPerAxis x strataPerAxis
+// samples, one per stratum. Rounds are added while the standard error of the pixel's luminance
+// is above errorThreshold, up to maxRounds. The error is only tested once there are two samples.
+struct CRTAdaptiveSettings
+{
+	int strataPerAxis = 2;
+	int maxRounds = 4;
+	float errorThreshold = 0.02f;
+};
+
+// How diffuse hits gather light. With samples 0 every light gets a shadow ray, otherwise that many
+// lights are importance-sampled from the scene's light tree. Lights whose unoccluded
+// intensity / (4 * pi * r^2) is below cullThreshold are skipped, 0 keeps them all.
+struct CRTLightSamplingSettings
+{
+	int samples = 0;
+	float cullThreshold = 0.f;
+};
+
+// Pixel rectangle [x0, x1) x [y0, y1) of the full frame
+struct CRTRenderRegion
+{
+	int x0 = 0;
+	int y0 = 0;
+	int x1 = 0;
+	int y1 = 0;
+};
+
+// How a render region is written: as an image of its own size, or into the full-size
+// image already in the output file
+enum class CRTRegionOutput
+{
+	CROP,
+	PATCH
 };
 
 class Renderer
 {
 public:
+	friend class CRTBenchmark;
+
 	Renderer(const CRTScene* scene);
 	void renderAnimation(const std::string& outputFileBaseName) const;
+	// Renders frames [firstFrame, firstFrame + frameCount) of the animation, clipped to its length
+	void renderAnimation(const std::string& outputFileBaseName, int firstFrame, int frameCount) const;
 	void renderScene(const std::string& outputFile) const;
 
-	static const int MAX_RAY_DEPTH = 5;
+	// Renders only the pixels of region, clipped to the image. Rays are generated with the projection
+	// of the full frame, so every pixel equals the one renderScene(outputFile) writes and regions
+	// rendered separately can be put together into the full frame. With PATCH an output file that
+	// is missing or of another size is replaced with a black frame first.
+	void renderScene(const std::string& outputFile, const CRTRenderRegion& region, CRTRegionOutput output) const;
+
+	// Renders one sample per pixel per pass and accumulates the passes until the sample cap
+	// or the time budget is reached, whichever comes first. The budget is checked between tiles,
+	// so the last pass may cover only part of the image. The average so far is written to
+	// outputFile every snapshotSeconds and once more at the end.
+	void renderProgressive(const std::string& outputFile, const CRTProgressiveSettings& settings) const;
+
+	// Off by default, one sample through the pixel centre. When enabled, renderScene and
+	// renderProgressive also write the samples per pixel as <output file>_spp.ppm
+	void setAdaptiveEnabled(bool enabled);
+	void setAdaptiveSettings(const CRTAdaptiveSettings& settings);
+
+	// Off by default, refractive hits trace both the reflected and the refracted ray and blend
+	// them with the Fresnel term. When enabled, one of the two is picked at random with the
+	// Fresnel probability. That is noisier per sample, but the cost grows linearly with the depth
+	// of nested glass instead of exponentially. Meant for multi-sample renders.
+	void setSingleBranchRefraction(bool enabled);
+
+	void setLightSampling(const CRTLightSamplingSettings& settings);
+
+	// Off by default. Every render thread remembers the last triangle that blocked each light
+	// and tests a new shadow ray against it before the full traversal. A cached blocker with
+	// glass in front of it is not trusted, the full traversal decides then, so the image stays
+	// the same as without the cache.
+	void setShadowCacheEnabled(bool enabled);
+
+	// Off by default. Shadow rays of camera-ray hits are queued per tile instead of traced inline,
+	// sorted by light and direction, traced as one batch with the any-hit query and then added to
+	// their pixels. Deeper bounces, adaptive sampling and heatmap renders keep the inline path.
+	void setShadowBatchingEnabled(bool enabled);
+
+	// Fraction of the time between two animation frames the shutter is open in renderAnimation,
+	// 0 by default. The camera keeps orbiting while it is open, the interval centred on the frame,
+	// which blurs multi-sample renders. Still images only blur when the scene camera itself records
+	// a motion between CRTCamera::openShutter and closeShutter.
+	void setShutter(float fraction);
+
+	// Sequence of the in-pixel sample positions of progressive and adaptive rendering,
+	// Sobol by default. The first sample of a pixel always goes through its centre.
+	void setSamplerType(CRTSamplerType type);
+	CRTSamplerType getSamplerType() const;
+
+	// Diagnostic render of the traversal cost per pixel, see CRTHeatmap.
+	// Writes the colour-mapped images and <base>.heatmap.raw instead of the rendered image.
+	void renderHeatmap(const std::string& outputFileBaseName) const;
+
+	// Defaults to the widest kernel the CPU supports
+	void setKernelType(CRTKernelType type);
+	CRTKernelType getKernelType() const;
+
+	// Number of threads rendering tiles, 0 uses one per hardware thread
+	void setThreadCount(int count);
+
+	// When enabled, renderScene and renderAnimation print the render statistics at the end
+	// and write them as JSON to the stats file, <output file>.stats.json by default
+	void setStatsEnabled(bool enabled);
+	void setStatsFile(const std::string& fileName);
+
+	static const int TILE_SIZE = 32;
+	static const int ANIMATION_FRAME_COUNT = 16;
+	// The camera orbits the animation target by this many degrees per frame
+	static constexpr float ANIMATION_FRAME_DEGREES = 20.f;
+	static const int SHUTTER_STEPS = 64;
 private:
 	const CRTScene* scene = nullptr;
 
-	CRTRay genRay(int x, int y, const CRTCamera& camera, int imageWidth, int imageHeight) const;
+	CRTKernelType kernelType = CRTKernelType::SCALAR;
+	CRTTriangleKernels::Kernel triangleKernel = &CRTTriangleKernels::intersectScalar;
+
+	int threadCount = 0;
+
+	bool statsEnabled = false;
+	std::string statsFile;
+
+	bool adaptiveEnabled = false;
+	CRTAdaptiveSettings adaptiveSettings;
+
+	CRTSamplerType samplerType = CRTSamplerType::SOBOL;
+
+	float shutter = 0.f;
+
+	bool singleBranchRefraction = false;
+
+	CRTLightSamplingSettings lightSampling;
+
+	bool shadowCacheEnabled = false;
+	bool shadowBatchingEnabled = false;
+
+	struct FrameOptions
+	{
+		// Pass of a progressive render, sample 0 goes through the pixel centres
+		int sampleIndex = 0;
+		CRTHeatmap* heatmap = nullptr;
+		// No tiles are started after the deadline
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+		bool printProgress = true;
+		// When set, the samples of every rendered pixel are added to accumulation
+		// and their number to sampleCounts
+		std::vector<CRTVector>* accumulation = nullptr;
+		std::vector<int>* sampleCounts = nullptr;
+		// Only the pixels of region are rendered, an empty region renders the whole frame
+		CRTRenderRegion region;
+		// Set by renderFrame for a moving camera, see getShutterFrames
+		const std::vector<CRTCameraFrame>* shutterFrames = nullptr;
+	};
+
+	void renderFrame(const CRTCamera& camera, std::vector<CRTVector>& framebuffer, CRTRenderStats* stats,
+					const FrameOptions& options) const;
+	void renderTile(const CRTCamera& camera, std::vector<CRTVector>& framebuffer, int x0, int y0, int x1, int y1,
+					const FrameOptions& options) const;
+	void writeImage(const std::string& outputFile, const std::vector<CRTVector>& framebuffer,
+					int screenWidth, int screenHeight) const;
+	void writeImage(const std::string& outputFile, const std::vector<CRTVector>& framebuffer,
+					int screenWidth, int screenHeight, const CRTRenderRegion& region, CRTRegionOutput output) const;
+	void writeSampleCountImage(const std::string& outputFile, const std::vector<int>& sampleCounts,
+							   int maxSampleCount, int screenWidth, int screenHeight, const CRTRenderRegion& region,
+							   CRTRegionOutput output) const;
+
+	// Average of the adaptive samples of pixel (x, y), sampleCount receives their number
+	CRTVector samplePixelAdaptive(int x, int y, const CRTCamera& camera, int sampleIndex,
+								  const std::vector<CRTCameraFrame>* shutterFrames, int& sampleCount) const;
+
+	// (sampleX, sampleY) is the position of the sample inside the pixel, in [0, 1). Sets up a
+	// CRTCameraFrame for the one ray, loops over many pixels keep their own frame instead.
+	CRTRay genRay(int x, int y, const CRTCamera& camera, int imageWidth, int imageHeight,
+				  float sampleX = 0.5f, float sampleY = 0.5f) const;
+
+	// Ray through image point (px, py) for a camera with a lens or shutter motion. A moving camera takes
+	// its frame at the sample's time from shutterFrames, otherwise frame is used.
+	CRTRay genLensRay(float px, float py, const CRTCameraSample& sample, const CRTCameraFrame& frame,
+					  const std::vector<CRTCameraFrame>* shutterFrames) const;
+
+	// Camera of animation frame k, orbiting the animation target, with the shutter motion recorded
+	CRTCamera getAnimationCamera(int frame) const;
+
+	// Frames of a moving camera at SHUTTER_STEPS + 1 evenly spaced times of the shutter interval,
+	// none for one that does not move. Rays interpolate between the two frames around their time.
+	std::vector<CRTCameraFrame> getShutterFrames(const CRTCamera& camera) const;
 
 	RayIntersectionData traceRay(const CRTRay& ray, float maxT = std::numeric_limits<float>::infinity()) const;
 
+	// Closest hit on one mesh's triangle stream through its BVH when it has one, else the triangle kernel,
+	// with the kernel's closestT contract. anyHit lets the BVH stop at the first hit.
+	int intersectMesh(const CRTMesh& mesh, const CRTRay& ray, float maxT, float& closestT, bool anyHit,
+					  CRTRenderStats* stats) const;
+
+	// Any-hit query for shadow rays: true as soon as a mesh that is not refractive is hit within maxT
+	// and no glass lies in front of it. With glass in front the closest hit within maxT decides.
+	bool isOccluded(const CRTRay& ray, float maxT) const;
+
+	// Whether a refractive mesh is hit before t. The closest-hit shadow test lets the light through
+	// such glass, so blockers found another way are only trusted when this is false.
+	bool isRefractiveHitBefore(const CRTRay& ray, float t) const;
+
+	// Traces the shadow rays queued while rendering a tile and adds the unblocked ones to their pixels
+	void traceShadowBatch(std::vector<CRTVector>& framebuffer) const;
+
 	bool isPointInTriangle(const CRTVector& point, const CRTTriangle& triangle) const;
 	
 	CRTVector calculatePointNormal(const CRTVector& point, const CRTMesh& mesh, int idx0, int idx1, int idx2) const;
 
 	CRTVector shade(const CRTRay& ray, const RayIntersectionData& data) const;
 
+	// Traces and shades a secondary ray, applying the depth limit and Russian roulette first
+	CRTVector traceAndShade(const CRTRay& ray) const;
+
 	CRTVector shadeDiffuse(const CRTRay& ray, const RayIntersectionData& data) const;
+	// Direct light from one light at a diffuse hit, including its shadow ray
+	CRTVector shadeLight(const CRTRay& ray, const RayIntersectionData& data, int lightIdx,
+						 const CRTVector& albedo, const CRTVector& normal, float weight) const;
 	CRTVector shadeReflective(const CRTRay& ray, const RayIntersectionData& data) const;
 	CRTVector shadeRefractive(const CRTRay& ray, const RayIntersectionData& data) const;
 	CRTVector shadeConstant(const CRTRay& ray, const RayIntersectionData& data) const;